@@ -0,0 +1,40 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "hanjadict.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Compile libhangul format dictionaries to the image read by the engine, so
+// it can be installed to the system data directory. Sources must be given in
+// the same order as the engine uses them.
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s <image> <source>...\n", argv[0]);
+        return 1;
+    }
+    std::vector<std::string> sources(argv + 2, argv + argc);
+    auto image = fcitx::HanjaDictionary::compile(sources);
+    if (!image) {
+        std::string names;
+        for (const auto &source : sources) {
+            names.append(" ").append(source);
+        }
+        std::fprintf(stderr, "Failed to compile%s\n", names.c_str());
+        return 1;
+    }
+    std::ofstream out(argv[1], std::ios::out | std::ios::binary |
+                                   std::ios::trunc);
+    out.write(image->data(), image->size());
+    out.close();
+    if (!out) {
+        std::fprintf(stderr, "Failed to write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -6,14 +6,22 @@
  */
 
 #include "engine.h"
+#include "preeditbuffer.h"
 #include <algorithm>
+#include <bit>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <fcitx-config/iniparser.h>
 #include <fcitx-config/rawconfig.h>
 #include <fcitx-utils/capabilityflags.h>
 #include <fcitx-utils/charutils.h>
+#include <fcitx-utils/cutf8.h>
+#include <fcitx-utils/event.h>
+#include <fcitx-utils/fs.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
+#include <fcitx-utils/log.h>
 #include <fcitx-utils/misc.h>
 #include <fcitx-utils/standardpaths.h>
 #include <fcitx-utils/textformatflags.h>
@@ -30,19 +38,30 @@
 #include <fcitx/text.h>
 #include <fcitx/userinterface.h>
 #include <fcitx/userinterfacemanager.h>
+#include <filesystem>
+#include <future>
 #include <hangul.h>
 #include <memory>
-#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <functional>
+#include <sys/inotify.h>
+#include <tuple>
+#include <unistd.h>
 #include <utility>
+#include <vector>
 
 static const char *keyboardId[] = {"2",  "2y", "39", "3f", "3s",
                                    "3y", "32", "ro", "ahn"};
 
-constexpr auto MAX_LENGTH = 40;
+constexpr uint64_t CONFIG_SAVE_DELAY = 1000000;
+
+constexpr std::string_view USER_DICTIONARY_FILE = "userdict.txt";
 
 namespace fcitx {
 
+FCITX_DEFINE_LOG_CATEGORY(hangul_log, "hangul");
+
 namespace {
 
 const KeyList &selectionKeys() {
@@ -53,59 +72,203 @@ const KeyList &selectionKeys() {
     return selectionKeys;
 }
 
-std::string ustringToUTF8(const std::u32string &ustr) {
-    std::string result;
-    for (auto c : ustr) {
-        result += utf8::UCS4ToUTF8(c);
+const std::vector<Text> &selectionLabels() {
+    static const std::vector<Text> selectionLabels = []() {
+        std::vector<Text> labels;
+        for (const auto &key : selectionKeys()) {
+            labels.emplace_back(key.toString() + ". ");
+        }
+        return labels;
+    }();
+    return selectionLabels;
+}
+
+// Append a nul terminated UCS-4 string to str, without any temporary string.
+void appendUCS4(std::string &str, const ucschar *ucs) {
+    if (!ucs) {
+        return;
+    }
+    char buf[FCITX_UTF8_MAX_LENGTH + 1];
+    for (; *ucs; ++ucs) {
+        str.append(buf, fcitx_ucs4_to_utf8(*ucs, buf));
     }
-    return result;
 }
 
-std::u32string ucsToUString(const ucschar *str) {
-    std::u32string result;
-    while (*str) {
-        result.push_back(*str);
-        str++;
+size_t ucsLength(const ucschar *ucs) {
+    size_t length = 0;
+    if (ucs) {
+        while (ucs[length]) {
+            ++length;
+        }
     }
-    return result;
+    return length;
 }
 
-std::string subUTF8String(const std::string &str, int p1, int p2) {
-    int limit;
-    int pos;
-    int n;
+bool isUTF8Continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
 
-    if (str.empty()) {
-        return "";
-    }
+// Number of utf8 continuation bytes in 8 bytes starting at str.
+int countContinuation(const char *str) {
+    uint64_t bytes;
+    memcpy(&bytes, str, sizeof(bytes));
+    // Bit 7 set and bit 6 clear. Shifting only moves bit 6 into bit 7 of
+    // the same byte after masking, so bytes don't affect each other.
+    return std::popcount(bytes & ~(bytes << 1) & 0x8080808080808080ULL);
+}
 
-    limit = str.size() + 1;
+// Byte offset of n-th character of str, or str.size() if str is shorter.
+// Whole 8 byte blocks are skipped by counting characters in them at once.
+size_t utf8Offset(std::string_view str, size_t n) {
+    size_t pos = 0;
+    while (pos + 8 <= str.size()) {
+        size_t chars = 8 - countContinuation(str.data() + pos);
+        if (chars > n) {
+            break;
+        }
+        n -= chars;
+        pos += 8;
+    }
+    // Block may end in the middle of a character.
+    while (pos < str.size() && isUTF8Continuation(str[pos])) {
+        pos++;
+    }
+    for (; pos < str.size(); pos++) {
+        if (isUTF8Continuation(str[pos])) {
+            continue;
+        }
+        if (n == 0) {
+            return pos;
+        }
+        n--;
+    }
+    return str.size();
+}
 
-    p1 = std::max(0, p1);
-    p2 = std::max(0, p2);
+size_t utf8Count(std::string_view str) {
+    size_t pos = 0;
+    size_t continuation = 0;
+    for (; pos + 8 <= str.size(); pos += 8) {
+        continuation += countContinuation(str.data() + pos);
+    }
+    for (; pos < str.size(); pos++) {
+        continuation += isUTF8Continuation(str[pos]);
+    }
+    return str.size() - continuation;
+}
 
-    pos = std::min(p1, p2);
-    n = std::abs(p2 - p1);
+// At most n characters before character position cursor. Only the text
+// before cursor is read.
+std::string_view utf8Before(std::string_view str, size_t cursor, size_t n) {
+    auto end = utf8Offset(str, cursor);
+    auto begin = end;
+    for (; n && begin > 0; n--) {
+        do {
+            --begin;
+        } while (begin > 0 && isUTF8Continuation(str[begin]));
+    }
+    return str.substr(begin, end - begin);
+}
 
-    if (pos + n > limit) {
-        n = limit - pos;
+// Characters between character positions p1 and p2.
+std::string_view utf8Between(std::string_view str, size_t p1, size_t p2) {
+    if (p1 > p2) {
+        std::swap(p1, p2);
     }
+    auto begin = utf8Offset(str, p1);
+    auto rest = str.substr(begin);
+    return rest.substr(0, utf8Offset(rest, p2 - p1));
+}
 
-    auto begin = utf8::nextNChar(str.begin(), pos);
-    auto end = utf8::nextNChar(begin, n);
+// Open the compiled image of text dictionary source. Images installed in
+// system data directories are preferred, since they are mapped read only and
+// their pages are shared by every fcitx process on the host. Otherwise the
+// image lives in user data directory and is rebuilt if it is missing or
+// outdated.
+std::unique_ptr<HanjaDictionary>
+loadDictionary(const std::vector<std::string> &sources,
+               const std::filesystem::path &image) {
+    if (sources.empty()) {
+        return nullptr;
+    }
+    const auto &sp = StandardPaths::global();
+    auto dict = std::make_unique<HanjaDictionary>();
+    auto imagePath = sp.userDirectory(StandardPathsType::PkgData) / image;
+    for (const auto &path : sp.locateAll(StandardPathsType::PkgData, image)) {
+        if (path != imagePath && dict->open(path.string(), sources)) {
+            HANGUL_DEBUG() << "Using shared dictionary " << path.string();
+            return dict;
+        }
+    }
+    if (dict->open(imagePath.string(), sources)) {
+        return dict;
+    }
 
-    return std::string(begin, end);
+    auto data = HanjaDictionary::compile(sources);
+    if (!data) {
+        HANGUL_WARN() << "Failed to load dictionary " << sources;
+        return nullptr;
+    }
+    HANGUL_DEBUG() << "Compiling " << sources << " to " << imagePath.string();
+    if (sp.safeSave(StandardPathsType::PkgData, image,
+                    [&data](int fd) {
+                        return fs::safeWrite(fd, data->data(), data->size()) ==
+                               static_cast<ssize_t>(data->size());
+                    }) &&
+        dict->open(imagePath.string(), sources)) {
+        return dict;
+    }
+    // Fallback to keep the image in memory if it can't be saved.
+    if (dict->load(std::move(*data))) {
+        return dict;
+    }
+    return nullptr;
 }
 
-HanjaTable *loadTable() {
-    const auto &sp = fcitx::StandardPaths::global();
+// Symbols and hanja are compiled into one table, symbols come first for the
+// same key.
+std::unique_ptr<HanjaDictionary> loadTable() {
+    const auto &sp = StandardPaths::global();
+    std::vector<std::string> sources;
+    if (auto symbolTxt =
+            sp.locate(StandardPathsType::PkgData, "hangul/symbol.txt");
+        !symbolTxt.empty()) {
+        sources.push_back(symbolTxt.string());
+    }
     auto hanjaTxt =
-        sp.locate(fcitx::StandardPathsType::Data, "libhangul/hanja/hanja.txt");
-    HanjaTable *table = nullptr;
+        sp.locate(StandardPathsType::Data, "libhangul/hanja/hanja.txt");
+#ifdef HANGUL_HANJA_FILE
+    if (hanjaTxt.empty()) {
+        hanjaTxt = HANGUL_HANJA_FILE;
+    }
+#endif
     if (!hanjaTxt.empty()) {
-        table = hanja_table_load(hanjaTxt.string().c_str());
+        sources.push_back(hanjaTxt.string());
     }
-    return table ? table : hanja_table_load(nullptr);
+    return loadDictionary(sources, "hangul/table.dict");
+}
+
+std::vector<HangulDictionaryEntry> toEntries(const HanjaMatches &list) {
+    std::vector<HangulDictionaryEntry> entries;
+    entries.reserve(list.size());
+    for (size_t i = 0; i < list.size(); i++) {
+        entries.push_back({list.key(i), list.value(i), list.comment(i)});
+    }
+    return entries;
+}
+
+std::string userDictionaryPath() {
+    return (StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+            "hangul" / USER_DICTIONARY_FILE)
+        .string();
+}
+
+std::unique_ptr<UserHistory> loadHistory() {
+    auto dir = StandardPaths::global().userDirectory(StandardPathsType::PkgData);
+    auto history = std::make_unique<UserHistory>();
+    history->open((dir / "hangul/history.dat").string(),
+                  (dir / "hangul/history.log").string());
+    return history;
 }
 
 } // namespace
@@ -124,17 +287,133 @@ private:
     int idx_;
 };
 
+// Candidate list backed by the matched entries of dictionary. Only candidate
+// words on current page are created, other entries are never touched.
+class HangulCandidateList : public CandidateList,
+                            public PageableCandidateList,
+                            public CursorMovableCandidateList {
+public:
+    HangulCandidateList(HangulEngine *engine, HanjaMatches list, int pageSize)
+        : engine_(engine), list_(std::move(list)),
+          pageSize_(std::max(pageSize, 1)) {
+        setPageable(this);
+        setCursorMovable(this);
+        updatePage();
+    }
+
+    const Text &label(int idx) const override {
+        static const Text emptyLabel;
+        const auto &labels = selectionLabels();
+        if (idx < 0 || idx >= static_cast<int>(labels.size())) {
+            return emptyLabel;
+        }
+        return labels[idx];
+    }
+
+    const CandidateWord &candidate(int idx) const override {
+        return *words_.at(idx);
+    }
+
+    int size() const override { return words_.size(); }
+
+    int cursorIndex() const override {
+        int idx = cursor_ - page_ * pageSize_;
+        if (idx < 0 || idx >= size()) {
+            return -1;
+        }
+        return idx;
+    }
+
+    CandidateLayoutHint layoutHint() const override {
+        return CandidateLayoutHint::NotSet;
+    }
+
+    bool hasPrev() const override { return page_ > 0; }
+
+    bool hasNext() const override { return page_ + 1 < totalPages(); }
+
+    void prev() override {
+        if (hasPrev()) {
+            setPage(page_ - 1);
+        }
+    }
+
+    void next() override {
+        if (hasNext()) {
+            setPage(page_ + 1);
+            usedNextBefore_ = true;
+        }
+    }
+
+    bool usedNextBefore() const override { return usedNextBefore_; }
+
+    int totalPages() const override {
+        return (totalSize() + pageSize_ - 1) / pageSize_;
+    }
+
+    int currentPage() const override { return page_; }
+
+    void setPage(int page) override {
+        if (page < 0 || page >= totalPages() || page == page_) {
+            return;
+        }
+        page_ = page;
+        // Reset cursor to the first candidate after paging.
+        cursor_ = page_ * pageSize_;
+        updatePage();
+    }
+
+    void prevCandidate() override { moveCursor(-1); }
+
+    void nextCandidate() override { moveCursor(1); }
+
+private:
+    int totalSize() const { return list_.size(); }
+
+    void moveCursor(int offset) {
+        if (!totalSize()) {
+            return;
+        }
+        cursor_ = (cursor_ + offset + totalSize()) % totalSize();
+        if (cursor_ / pageSize_ != page_) {
+            page_ = cursor_ / pageSize_;
+            updatePage();
+        }
+    }
+
+    void updatePage() {
+        words_.clear();
+        auto end = std::min((page_ + 1) * pageSize_, totalSize());
+        for (auto i = page_ * pageSize_; i < end; i++) {
+            words_.push_back(std::make_unique<HangulCandidate>(
+                engine_, i, std::string(list_.value(i))));
+        }
+    }
+
+    HangulEngine *engine_;
+    HanjaMatches list_;
+    int pageSize_;
+    int page_ = 0;
+    int cursor_ = 0;
+    bool usedNextBefore_ = false;
+    std::vector<std::unique_ptr<HangulCandidate>> words_;
+};
+
 class HangulState : public InputContextProperty {
 public:
     HangulState(HangulEngine *engine, InputContext *ic)
-        : engine_(engine), ic_(ic) {
-        configure();
-    }
+        : engine_(engine), ic_(ic) {}
 
-    void configure() {
-        context_.reset(hangul_ic_new(
-            keyboardId[static_cast<int>(*engine_->config().keyboard)]));
+    // Apply the composition options to existing context, keeping the
+    // composition.
+    void updateOptions() {
+        if (automaton_) {
+            automaton_->setOptions(engine_->automatonOptions());
+        }
 #if defined(FCITX_HANGUL_VERSION_0_2)
+        if (!context_) {
+            return;
+        }
         hangul_ic_set_option(context_.get(), HANGUL_IC_OPTION_AUTO_REORDER,
                              *engine_->config().autoReorder);
         hangul_ic_set_option(context_.get(),
@@ -143,11 +422,66 @@ public:
         hangul_ic_set_option(context_.get(),
                              HANGUL_IC_OPTION_NON_CHOSEONG_COMBI,
                              *engine_->config().nonChoseongCombi);
+#endif
+    }
+
+    // Context is created on the first key that may compose. If keyboard is
+    // changed since the context is created, composition is committed and the
+    // context is created again with the new keyboard. The built-in automaton
+    // replaces the libhangul context if the keyboard has one.
+    void prepareContext() {
+        lastActive_ = now(CLOCK_MONOTONIC);
+        if (hasContext() &&
+            keyboardGeneration_ == engine_->keyboardGeneration()) {
+            return;
+        }
+        if (hasContext()) {
+            flush();
+            updateUI();
+        }
+        context_.reset();
+        automaton_.reset();
+        keyboardGeneration_ = engine_->keyboardGeneration();
+        if (const auto *layout = engine_->automatonLayout()) {
+            automaton_ = std::make_unique<HangulAutomaton>(
+                layout, engine_->automatonOptions());
+        } else {
+            context_.reset(hangul_ic_new(
+                keyboardId[static_cast<int>(*engine_->config().keyboard)]));
+#if defined(FCITX_HANGUL_VERSION_0_2)
+            updateOptions();
 #else
-        hangul_ic_connect_callback(
-            context_.get(), "transition",
-            reinterpret_cast<void *>(&HangulState::onTransitionCallback), this);
+            hangul_ic_connect_callback(
+                context_.get(), "transition",
+                reinterpret_cast<void *>(&HangulState::onTransitionCallback),
+                this);
 #endif
+        }
+        engine_->scheduleReleaseIdle();
+    }
+
+    // Free everything allocated for composition if nothing is being composed
+    // and no key is typed since idleSince. Return true if there is nothing
+    // left to release.
+    bool releaseIfIdle(uint64_t idleSince) {
+        if (!hasContext()) {
+            return true;
+        }
+        if (lastActive_ > idleSince || isComposing()) {
+            return false;
+        }
+        context_.reset();
+        automaton_.reset();
+        setHanjaList({});
+        tableCursor_.reset();
+        precomputed_ = {};
+        for (auto *str : {&buffer_, &lookupKey_, &hanjaListKey_,
+                          &lastPreedit_, &lastHicPreedit_,
+                          &lastPreeditAfter_}) {
+            std::string().swap(*str);
+        }
+        preedit_.release();
+        return true;
     }
 
 #if !defined(FCITX_HANGUL_VERSION_0_2)
@@ -178,103 +512,217 @@ public:
     }
 #endif
 
-    void updateLookupTable(bool checkSurrounding) {
-        std::string hanjaKey;
+    // Key to look up for the preedit, or for surrounding text if
+    // checkSurrounding and nothing is being composed. The key is left in
+    // lookupKey_, which is empty if there is nothing to look up.
+    LookupMethod updateLookupKey(bool checkSurrounding) {
         LookupMethod lookupMethod = LookupMethod::LOOKUP_METHOD_PREFIX;
-
-        hanjaList_.reset();
-
-        const auto *hic_preedit = hangul_ic_get_preedit_string(context_.get());
-        std::u32string preedit = preedit_;
-        preedit.append(ucsToUString(hic_preedit));
-        if (!preedit.empty()) {
-            auto utf8 = ustringToUTF8(preedit);
+        const auto *hic_preedit = hicPreedit();
+        auto &hanjaKey = lookupKey_;
+        hanjaKey.clear();
+        if (!preedit_.empty() || (hic_preedit && hic_preedit[0])) {
+            // Only the start of a long preedit may match.
+            size_t limit = std::string::npos;
             if (*engine_->config().wordCommit || *engine_->config().hanjaMode) {
-                hanjaKey = std::move(utf8);
                 lookupMethod = LookupMethod::LOOKUP_METHOD_PREFIX;
+                if (auto maxKeyLength = engine_->maxKeyLength()) {
+                    limit = maxKeyLength;
+                }
             } else {
-                auto cursorPos = ic_->surroundingText().cursor();
-                auto substr =
-                    subUTF8String(ic_->surroundingText().text(),
-                                  static_cast<int>(cursorPos) - 64, cursorPos);
-
-                if (!substr.empty()) {
-                    hanjaKey = substr + utf8;
-                } else {
-                    hanjaKey = std::move(utf8);
+                // Keys longer than any key in the tables never match.
+                auto preeditLength = preedit_.size() + ucsLength(hic_preedit);
+                auto maxKeyLength = engine_->maxKeyLength();
+                if (maxKeyLength > preeditLength) {
+                    hanjaKey = utf8Before(ic_->surroundingText().text(),
+                                          ic_->surroundingText().cursor(),
+                                          maxKeyLength - preeditLength);
                 }
                 lookupMethod = LookupMethod::LOOKUP_METHOD_SUFFIX;
             }
+            appendPreeditText(hanjaKey, hic_preedit, limit);
         } else if (checkSurrounding) {
 
             if (!ic_->capabilityFlags().test(CapabilityFlag::SurroundingText) ||
                 !ic_->surroundingText().isValid()) {
-                return;
+                return lookupMethod;
             }
             const auto &surroundingStr = ic_->surroundingText().text();
             auto cursorPos = ic_->surroundingText().cursor();
             auto anchorPos = ic_->surroundingText().anchor();
             if (cursorPos != anchorPos) {
                 // If we have selection in surrounding text, we use that.
-                hanjaKey = subUTF8String(surroundingStr, cursorPos, anchorPos);
+                hanjaKey = utf8Between(surroundingStr, cursorPos, anchorPos);
                 lookupMethod = LookupMethod::LOOKUP_METHOD_EXACT;
             } else {
-                hanjaKey =
-                    subUTF8String(surroundingStr,
-                                  static_cast<int>(cursorPos) - 64, cursorPos);
+                hanjaKey = utf8Before(surroundingStr, cursorPos,
+                                      engine_->maxKeyLength());
                 lookupMethod = LookupMethod::LOOKUP_METHOD_SUFFIX;
             }
         }
+        return lookupMethod;
+    }
 
-        if (!hanjaKey.empty()) {
-            hanjaList_.reset(lookupTable(hanjaKey, lookupMethod));
-            lastLookupMethod_ = lookupMethod;
+    // With deferred, a key not looked up before is left to precompute(), so
+    // the key event returns without waiting for the lookup.
+    void updateLookupTable(bool checkSurrounding, bool deferred = false) {
+        lookupPending_ = false;
+        // Length of surrounding text to read depends on the tables.
+        engine_->prepareTables(checkSurrounding);
+
+        auto lookupMethod = updateLookupKey(checkSurrounding);
+        if (lookupKey_.empty()) {
+            setHanjaList({});
+            return;
         }
+        if (!isPrecomputed(lookupKey_, lookupMethod)) {
+            if (deferred) {
+                // Last list stays until the result is ready, so the
+                // candidate window doesn't hide and show on every key.
+                lookupPending_ = true;
+                schedulePrecompute();
+                return;
+            }
+            precompute(lookupKey_, lookupMethod, checkSurrounding);
+        }
+        setHanjaList(precomputed_.list);
+        hanjaListKey_ = lookupKey_;
+        lastLookupMethod_ = lookupMethod;
+    }
+
+    bool isPrecomputed(const std::string &key, LookupMethod method) const {
+        return precomputed_.valid && precomputed_.method == method &&
+               precomputed_.key == key;
     }
 
-    HanjaList *lookupTable(const std::string &key, LookupMethod method) {
-        HanjaList *list = nullptr;
+    void precompute(const std::string &key, LookupMethod method, bool wait) {
+        precomputed_.list = lookupTable(key, method, wait);
+        rankByHistory(precomputed_.list);
+        precomputed_.key = key;
+        precomputed_.method = method;
+        // Nothing is found if the tables are still loading, try again later.
+        precomputed_.valid = engine_->table() != nullptr;
+    }
 
-        if (key.empty()) {
-            return nullptr;
+    // Run once the key events queued so far are handled.
+    void schedulePrecompute() {
+        if (precomputeEvent_) {
+            if (!precomputeEvent_->isEnabled()) {
+                precomputeEvent_->setOneShot();
+            }
+            return;
         }
+        precomputeEvent_ =
+            engine_->instance()->eventLoop().addDeferEvent([this](EventSource *) {
+                onIdle();
+                return true;
+            });
+    }
 
-        decltype(&hanja_table_match_exact) func = nullptr;
+    // Do now what is left to the event loop, if there is anything.
+    void runIdle() {
+        if (precomputeEvent_ && precomputeEvent_->isEnabled()) {
+            precomputeEvent_->setEnabled(false);
+            onIdle();
+        }
+    }
 
-        switch (method) {
-        case LookupMethod::LOOKUP_METHOD_EXACT:
-            func = &hanja_table_match_exact;
-            break;
-        case LookupMethod::LOOKUP_METHOD_PREFIX:
-            func = &hanja_table_match_prefix;
-            break;
-        case LookupMethod::LOOKUP_METHOD_SUFFIX:
-            func = &hanja_table_match_suffix;
-            break;
+    // Finish the lookup deferred by the last key. If there is nothing to
+    // show, look up what the hanja key would, so it shows the candidates
+    // without a lookup. Tables are not loaded only for this.
+    void onIdle() {
+        if (lookupPending_) {
+            updateLookupTable(false);
+            updateUI();
         }
-        if (!func) {
-            return nullptr;
+        if (!hanjaList_.empty() || !engine_->tablesRequested() ||
+            !engine_->prepareTables(false)) {
+            return;
+        }
+        auto lookupMethod = updateLookupKey(true);
+        if (!lookupKey_.empty() && !isPrecomputed(lookupKey_, lookupMethod)) {
+            precompute(lookupKey_, lookupMethod, false);
         }
+    }
 
-        if (auto *symbolTable = engine_->symbolTable()) {
-            list = func(symbolTable, key.data());
+    // Show entries selected before first. Only a fixed number of entries is
+    // checked for each matched key, no matter how long the history is.
+    void rankByHistory(HanjaMatches &list) {
+        const auto *history = engine_->history();
+        if (!history || list.empty()) {
+            return;
+        }
+        std::vector<uint32_t> promoted;
+        UserHistory::Preferred preferred[UserHistory::MaxPreferred];
+        size_t offset = 0;
+        for (size_t i = 0; i < list.keyCount(); i++) {
+            auto entryCount = list.keyEntryCount(i);
+            auto count = history->preferred(list.key(offset), preferred);
+            for (size_t j = 0; j < count; j++) {
+                // Ignore the entries no longer in the same place, e.g. the
+                // dictionary is updated.
+                auto idx = offset + preferred[j].index;
+                if (preferred[j].index < entryCount &&
+                    UserHistory::valueHash(list.value(idx)) ==
+                        preferred[j].valueHash) {
+                    promoted.push_back(idx);
+                }
+            }
+            offset += entryCount;
+        }
+        if (!promoted.empty()) {
+            list.promote(promoted);
         }
+    }
+
+    HanjaMatches lookupTable(const std::string &key, LookupMethod method,
+                             bool wait) {
+        LatencyTimer timer(engine_->latency(), LatencyStage::Lookup);
+        HanjaMatches list;
 
-        if (!list) {
-            list = func(engine_->table(), key.data());
+        // Only wait for the tables if user explicitly asks for hanja, so
+        // composition is never blocked by loading them.
+        if (key.empty() || !engine_->prepareTables(wait)) {
+            return list;
         }
 
+        const auto *table = engine_->table();
+        if (method == LookupMethod::LOOKUP_METHOD_PREFIX) {
+            // Key usually grows or shrinks by one character between two
+            // prefix lookups, so narrow down the result of last lookup.
+            list = tableCursor_.match(table, key);
+        } else if (table && method == LookupMethod::LOOKUP_METHOD_EXACT) {
+            list = table->matchExact(key);
+        } else if (table && method == LookupMethod::LOOKUP_METHOD_SUFFIX) {
+            list = table->matchSuffix(key);
+        }
+        engine_->matchUserDictionary(key, method, list);
         return list;
     }
 
+    // Lists may reference the entries of user dictionary that are replaced,
+    // so drop them and look up the shown candidates again.
+    void dictionaryChanged() {
+        precomputed_ = {};
+        if (hanjaList_.empty()) {
+            return;
+        }
+        // lookupKey_ may already be the key of a deferred lookup, or of the
+        // one done ahead for the hanja key.
+        setHanjaList({});
+        precompute(hanjaListKey_, lastLookupMethod_, false);
+        setHanjaList(precomputed_.list);
+        updateUI();
+    }
+
     void keyEvent(KeyEvent &keyEvent) {
         if (keyEvent.isRelease()) {
             return;
         }
+        LatencyTimer timer(engine_->latency(), LatencyStage::KeyEvent);
 
         if (keyEvent.key().checkKeyList(
                 *engine_->config().hanjaModeToggleKey)) {
-            if (!hanjaList_) {
+            if (hanjaList_.empty()) {
                 updateLookupTable(true);
             } else {
                 cleanup();
@@ -290,17 +738,6 @@ public:
             return;
         }
 
-        KeyStates s;
-        for (const auto *keyList :
-             {&*engine_->config().hanjaModeToggleKey,
-              &*engine_->config().prevPageKey, &*engine_->config().nextPageKey,
-              &*engine_->config().prevCandidateKey,
-              &*engine_->config().nextCandidateKey}) {
-            for (auto key : *keyList) {
-                s |= key.states();
-            }
-        }
-
         struct {
             KeyState state;
             KeySym left, right;
@@ -312,14 +749,24 @@ public:
             {KeyState::Hyper, FcitxKey_Hyper_L, FcitxKey_Hyper_R},
         };
 
+        const auto shortcutStates = engine_->shortcutStates();
         for (auto &modifier : modifiers) {
-            if (s & modifier.state) {
+            if (shortcutStates & modifier.state) {
                 if (sym == modifier.left || sym == modifier.right) {
                     return;
                 }
             }
         }
 
+        // Candidates shown may be the ones of an earlier key, pick from the
+        // ones of the current key.
+        if (lookupPending_ && !hanjaList_.empty() &&
+            (keyEvent.key().keyListIndex(selectionKeys()) >= 0 ||
+             keyEvent.key().check(FcitxKey_Return))) {
+            updateLookupTable(false);
+            updateUI();
+        }
+
         // Handle candidate selection.
         auto candList = ic_->inputPanel().candidateList();
         if (candList && !candList->empty()) {
@@ -376,63 +823,87 @@ public:
             }
         }
 
-        s = KeyStates{KeyState::Ctrl, KeyState::Alt, KeyState::Shift,
-                      KeyState::Super, KeyState::Hyper};
-        if (keyEvent.key().states() & s) {
-            flush();
+        // revert capslock
+        if (keyEvent.rawKey().states().test(KeyState::CapsLock)) {
+            if (sym >= 'A' && sym <= 'z') {
+                if (charutils::isupper(sym)) {
+                    sym = static_cast<KeySym>(charutils::tolower(sym));
+                } else {
+                    sym = static_cast<KeySym>(charutils::toupper(sym));
+                }
+            }
+        }
+
+        // Move the cursor inside the preedit, after putting the hic preedit
+        // into it.
+        if ((keyEvent.key().check(FcitxKey_Left) ||
+             keyEvent.key().check(FcitxKey_Right)) &&
+            (*engine_->config().wordCommit || *engine_->config().hanjaMode) &&
+            (!preedit_.empty() || !composeEmpty())) {
+            preedit_.insert(composeFlush());
+            if (keyEvent.key().check(FcitxKey_Left)) {
+                preedit_.moveLeft();
+            } else {
+                preedit_.moveRight();
+            }
+            if (*engine_->config().hanjaMode) {
+                updateLookupTable(false, /*deferred=*/true);
+            } else {
+                cleanup();
+            }
             updateUI();
+            keyEvent.filterAndAccept();
+            return;
+        }
+
+        // Shortcuts and keys that the layout never takes only end the
+        // composition, skip everything if there is nothing to end.
+        const KeyStates s{KeyState::Ctrl, KeyState::Alt, KeyState::Shift,
+                          KeyState::Super, KeyState::Hyper};
+        if ((keyEvent.key().states() & s) ||
+            (!keyEvent.key().check(FcitxKey_BackSpace) &&
+             !engine_->isKeyHandled(sym))) {
+            if (isComposing()) {
+                flush();
+                updateUI();
+            }
             return;
         }
 
         bool keyUsed = false;
         if (keyEvent.key().check(FcitxKey_BackSpace)) {
-            keyUsed = hangul_ic_backspace(context_.get());
-            if (!keyUsed) {
-                unsigned int preedit_len = preedit_.size();
-                if (preedit_len > 0) {
-                    preedit_.pop_back();
-                    keyUsed = true;
-                }
+            {
+                LatencyTimer timer(engine_->latency(), LatencyStage::Process);
+                keyUsed = hasContext() && composeBackspace();
             }
-        } else {
-            if (preedit_.size() >= MAX_LENGTH) {
-                flush();
+            // Taken even if the cursor is at the start, the text after
+            // it is still in the preedit.
+            if (!keyUsed && !preedit_.empty()) {
+                preedit_.backspace();
+                keyUsed = true;
             }
-
-            // revert capslock
-            if (keyEvent.rawKey().states().test(KeyState::CapsLock)) {
-                if (sym >= 'A' && sym <= 'z') {
-                    if (charutils::isupper(sym)) {
-                        sym = static_cast<KeySym>(charutils::tolower(sym));
-                    } else {
-                        sym = static_cast<KeySym>(charutils::toupper(sym));
-                    }
-                }
+        } else {
+            {
+                LatencyTimer timer(engine_->latency(), LatencyStage::Process);
+                keyUsed = composeKey(sym);
             }
-
-            keyUsed = hangul_ic_process(context_.get(), sym);
             bool notFlush = false;
 
-            const ucschar *str = hangul_ic_get_commit_string(context_.get());
+            const ucschar *str = composeCommit();
             if (*engine_->config().wordCommit || *engine_->config().hanjaMode) {
                 const ucschar *hic_preedit;
 
-                hic_preedit = hangul_ic_get_preedit_string(context_.get());
-                preedit_.append(ucsToUString(str));
+                hic_preedit = hicPreedit();
+                preedit_.insert(str);
                 if (hic_preedit == nullptr || hic_preedit[0] == 0) {
-                    if (!preedit_.empty()) {
-                        auto commit = ustringToUTF8(preedit_);
-                        if (!commit.empty()) {
-                            ic_->commitString(commit);
-                        }
-                    }
-                    preedit_.clear();
+                    commitPreedit();
                 }
             } else {
                 if (str != nullptr && str[0] != 0) {
-                    auto commit = ustringToUTF8(ucsToUString(str));
-                    if (!commit.empty()) {
-                        ic_->commitString(commit);
+                    buffer_.clear();
+                    appendUCS4(buffer_, str);
+                    if (!buffer_.empty()) {
+                        commit(buffer_);
                     }
                 }
             }
@@ -442,8 +913,12 @@ public:
             }
         }
 
+        // Without hanja mode, nothing is looked up until the hanja key.
         if (*engine_->config().hanjaMode) {
-            updateLookupTable(false);
+            updateLookupTable(false, /*deferred=*/true);
+            if (hanjaList_.empty() && !lookupPending_) {
+                schedulePrecompute();
+            }
         } else {
             cleanup();
         }
@@ -454,108 +929,178 @@ public:
         }
     }
 
+    // Handle keys as if they are typed one by one, but only commit once and
+    // update the input panel once at the end. Keys not taken by the engine
+    // are committed as text if they are printable, otherwise the collected
+    // text is committed and the key is forwarded to the application.
+    void processKeys(const std::vector<Key> &keys) {
+        batching_ = true;
+        for (auto key : keys) {
+            key = key.normalize();
+            KeyEvent event(ic_, key, false);
+            keyEvent(event);
+            if (event.accepted()) {
+                continue;
+            }
+            auto chr = Key::keySymToUnicode(key.sym());
+            if (chr >= 0x20 && chr != 0x7f &&
+                !key.states().testAny(KeyStates{KeyState::Ctrl, KeyState::Alt,
+                                                KeyState::Super,
+                                                KeyState::Hyper})) {
+                pendingCommit_.append(utf8::UCS4ToUTF8(chr));
+                continue;
+            }
+            // Application sees the key after the text and preedit before it.
+            batching_ = false;
+            flushBatch();
+            ic_->forwardKey(key, false);
+            ic_->forwardKey(key, true);
+            batching_ = true;
+        }
+        batching_ = false;
+        flushBatch();
+    }
+
     void reset() {
-        preedit_.clear();
-        hangul_ic_reset(context_.get());
-        hanjaList_.reset();
+        clearPreedit();
+        composeReset();
+        cleanup();
+        // Input panel might be changed by others, so don't trust the cache.
+        invalidateUI();
         updateUI();
     }
 
-    void cleanup() { hanjaList_.reset(); }
+    void cleanup() {
+        setHanjaList({});
+        lookupPending_ = false;
+    }
+
+    bool isComposing() const {
+        return !preedit_.empty() ||
+               !composeEmpty() ||
+               !hanjaList_.empty();
+    }
+
+    void invalidateUI() { uiValid_ = false; }
 
     void flush() {
         cleanup();
 
-        const auto *str = hangul_ic_flush(context_.get());
-
-        preedit_ += ucsToUString(str);
+        preedit_.insert(composeFlush());
+        commitPreedit();
+    }
 
-        if (preedit_.empty()) {
+    // Only send the part of input panel that is changed since last update.
+    void updateUI() {
+        if (batching_) {
+            uiPending_ = true;
             return;
         }
-
-        auto utf8 = ustringToUTF8(preedit_);
-        if (!utf8.empty()) {
-            ic_->commitString(utf8);
+        LatencyTimer timer(engine_->latency(), LatencyStage::UpdateUI);
+        const ucschar *hic_preedit = hicPreedit();
+        auto &inputPanel = ic_->inputPanel();
+
+        // Composition is shown at the cursor.
+        auto pre1 = preedit_.textBefore();
+        auto &pre2 = buffer_;
+        pre2.clear();
+        appendUCS4(pre2, hic_preedit);
+        auto pre3 = preedit_.textAfter();
+        bool clientPreedit =
+            ic_->capabilityFlags().test(CapabilityFlag::Preedit);
+
+        if (uiValid_) {
+            const auto &shown = lastClientPreedit_ ? inputPanel.clientPreedit()
+                                                   : inputPanel.preedit();
+            if ((shown.size() == 0) !=
+                    (lastPreedit_.empty() && lastHicPreedit_.empty() &&
+                     lastPreeditAfter_.empty()) ||
+                inputPanel.candidateList().get() != lastCandidateList_) {
+                uiValid_ = false;
+            }
         }
 
-        preedit_.clear();
-    }
-
-    void updateUI() {
-        const ucschar *hic_preedit =
-            hangul_ic_get_preedit_string(context_.get());
-
-        ic_->inputPanel().reset();
+        bool preeditChanged = !uiValid_ || clientPreedit != lastClientPreedit_ ||
+                              pre1 != lastPreedit_ || pre2 != lastHicPreedit_ ||
+                              pre3 != lastPreeditAfter_;
+        bool candidateChanged = !uiValid_ || candidateChanged_;
+        if (!preeditChanged && !candidateChanged) {
+            return;
+        }
 
-        std::string pre1 = ustringToUTF8(preedit_);
-        std::string pre2;
-        if (hic_preedit) {
-            pre2 = ustringToUTF8(ucsToUString(hic_preedit));
+        if (!uiValid_) {
+            inputPanel.reset();
         }
 
-        if (!pre1.empty() || !pre2.empty()) {
+        if (preeditChanged) {
             Text text;
-            text.append(pre1);
-            text.append(pre2, TextFormatFlag::HighLight);
-            text.setCursor(pre1.size() + pre2.size());
-            if (ic_->capabilityFlags().test(CapabilityFlag::Preedit)) {
-                ic_->inputPanel().setClientPreedit(text);
+            if (!pre1.empty() || !pre2.empty() || !pre3.empty()) {
+                text.append(std::string(pre1));
+                text.append(pre2, TextFormatFlag::HighLight);
+                text.append(std::string(pre3));
+                text.setCursor(pre1.size() + pre2.size());
+            }
+            if (clientPreedit) {
+                inputPanel.setClientPreedit(text);
+                inputPanel.setPreedit(Text());
             } else {
-                ic_->inputPanel().setPreedit(text);
+                inputPanel.setPreedit(text);
+                inputPanel.setClientPreedit(Text());
             }
+            ic_->updatePreedit();
+            lastPreedit_ = pre1;
+            lastHicPreedit_ = pre2;
+            lastPreeditAfter_ = pre3;
+            lastClientPreedit_ = clientPreedit;
         }
-        ic_->updatePreedit();
 
-        setLookupTable();
+        if (candidateChanged) {
+            setLookupTable();
+            lastCandidateList_ = inputPanel.candidateList().get();
+            candidateChanged_ = false;
+        }
 
+        uiValid_ = true;
         ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
     }
 
     void setLookupTable() {
-        if (!hanjaList_) {
+        LatencyTimer timer(engine_->latency(), LatencyStage::CandidateList);
+        if (hanjaList_.empty()) {
+            ic_->inputPanel().setCandidateList(nullptr);
             return;
         }
-        HanjaList *list = hanjaList_.get();
-        if (list) {
-            auto candidate = std::make_unique<CommonCandidateList>();
-            candidate->setSelectionKey(selectionKeys());
-            candidate->setCursorPositionAfterPaging(
-                CursorPositionAfterPaging::ResetToFirst);
-            candidate->setPageSize(
-                engine_->instance()->globalConfig().defaultPageSize());
-            auto n = hanja_list_get_size(list);
-            for (auto i = 0; i < n; i++) {
-                const char *value = hanja_list_get_nth_value(list, i);
-                candidate->append<HangulCandidate>(engine_, i, value);
-            }
-            if (n) {
-                candidate->setGlobalCursorIndex(0);
-                ic_->inputPanel().setCandidateList(std::move(candidate));
-            }
-        }
+        ic_->inputPanel().setCandidateList(
+            std::make_unique<HangulCandidateList>(
+                engine_, hanjaList_,
+                engine_->instance()->globalConfig().defaultPageSize()));
     }
 
     void select(int pos) {
-        const char *key;
-        const char *value;
+        LatencyTimer timer(engine_->latency(), LatencyStage::Select);
+        std::string_view key;
+        std::string_view value;
         const ucschar *hic_preedit;
         int key_len;
         int preedit_len;
         int hic_preedit_len;
 
-        key = hanja_list_get_nth_key(hanjaList_.get(), pos);
-        value = hanja_list_get_nth_value(hanjaList_.get(), pos);
-        hic_preedit = hangul_ic_get_preedit_string(context_.get());
+        key = hanjaList_.key(pos);
+        value = hanjaList_.value(pos);
+        hic_preedit = hicPreedit();
 
-        if (!key || !value || !hic_preedit) {
+        if (key.empty() || value.empty() || !hic_preedit) {
             reset();
             return;
         }
 
-        key_len = fcitx::utf8::length(std::string(key));
+        engine_->addHistory(key, value, hanjaList_.entryIndex(pos));
+        // Order of candidates is changed.
+        precomputed_.valid = false;
+
+        key_len = utf8Count(key);
         preedit_len = preedit_.size();
-        hic_preedit_len = ucsToUString(hic_preedit).size();
+        hic_preedit_len = ucsLength(hic_preedit);
 
         bool surrounding = false;
         if (lastLookupMethod_ == LookupMethod::LOOKUP_METHOD_PREFIX) {
@@ -566,32 +1111,40 @@ public:
                     surrounding = true;
                 }
             } else {
-                /* remove preedit text */
+                // Key is the start of preedit, which has hic preedit at the
+                // cursor.
+                int before = preedit_.cursor();
+
+                /* remove preedit text before cursor */
                 if (key_len > 0) {
-                    long n = std::min(key_len, preedit_len);
-                    preedit_.erase(0, n);
-                    key_len -= preedit_len;
+                    erasePreedit(std::min(key_len, before));
+                    key_len -= before;
                 }
 
                 /* remove hic preedit text */
-                if (key_len > 0) {
-                    hangul_ic_reset(context_.get());
+                if (key_len > 0 && hasContext()) {
+                    composeReset();
                     key_len -= hic_preedit_len;
                 }
+
+                /* remove preedit text after cursor */
+                if (key_len > 0) {
+                    erasePreedit(key_len);
+                }
             }
         } else {
             /* remove hic preedit text */
             if (hic_preedit_len > 0) {
-                hangul_ic_reset(context_.get());
+                composeReset();
                 key_len -= hic_preedit_len;
             }
 
             /* remove preedit text */
             if (key_len > preedit_len) {
-                preedit_.erase(0, preedit_len);
+                erasePreedit(preedit_len);
                 key_len -= preedit_len;
             } else if (key_len > 0) {
-                preedit_.erase(0, key_len);
+                erasePreedit(key_len);
                 key_len = 0;
             }
 
@@ -603,7 +1156,7 @@ public:
             }
         }
 
-        ic_->commitString(value);
+        commit(value);
         if (surrounding) {
             cleanup();
         }
@@ -612,42 +1165,200 @@ public:
     }
 
 private:
+    void commit(std::string_view text) {
+        if (batching_) {
+            pendingCommit_.append(text);
+            return;
+        }
+        ic_->commitString(std::string(text));
+    }
+
+    void commitPending() {
+        if (!pendingCommit_.empty()) {
+            ic_->commitString(pendingCommit_);
+            pendingCommit_.clear();
+        }
+    }
+
+    // Send what processKeys has held back.
+    void flushBatch() {
+        commitPending();
+        if (uiPending_) {
+            uiPending_ = false;
+            updateUI();
+        }
+    }
+
+    void setHanjaList(HanjaMatches list) {
+        if (list == hanjaList_) {
+            return;
+        }
+        hanjaList_ = std::move(list);
+        candidateChanged_ = true;
+    }
+
+    const ucschar *hicPreedit() const {
+        static const ucschar empty[] = {0};
+        if (automaton_) {
+            return automaton_->preeditString();
+        }
+        return context_ ? hangul_ic_get_preedit_string(context_.get()) : empty;
+    }
+
+    bool hasContext() const { return context_ || automaton_; }
+
+    // Same as hangul_ic_*, on whichever of context_ and automaton_ is used.
+    bool composeKey(int ascii) {
+        prepareContext();
+        return automaton_ ? automaton_->process(ascii)
+                          : hangul_ic_process(context_.get(), ascii);
+    }
+
+    bool composeBackspace() {
+        prepareContext();
+        return automaton_ ? automaton_->backspace()
+                          : hangul_ic_backspace(context_.get());
+    }
+
+    void composeReset() {
+        if (automaton_) {
+            automaton_->reset();
+        } else if (context_) {
+            hangul_ic_reset(context_.get());
+        }
+    }
+
+    const ucschar *composeFlush() {
+        if (automaton_) {
+            return automaton_->flush();
+        }
+        return context_ ? hangul_ic_flush(context_.get()) : nullptr;
+    }
+
+    const ucschar *composeCommit() const {
+        if (automaton_) {
+            return automaton_->commitString();
+        }
+        return context_ ? hangul_ic_get_commit_string(context_.get())
+                        : nullptr;
+    }
+
+    bool composeEmpty() const {
+        if (automaton_) {
+            return automaton_->isEmpty();
+        }
+        return !context_ || hangul_ic_is_empty(context_.get());
+    }
+
+    // Append characters [begin, end) of preedit_ to str.
+    void appendPreedit(std::string &str, size_t begin, size_t end) const {
+        char buf[FCITX_UTF8_MAX_LENGTH + 1];
+        for (auto i = begin; i < end; i++) {
+            str.append(buf, fcitx_ucs4_to_utf8(preedit_[i], buf));
+        }
+    }
+
+    // Append the first limit characters of preedit as shown, with the hic
+    // preedit at the cursor.
+    void appendPreeditText(std::string &str, const ucschar *hic_preedit,
+                           size_t limit) const {
+        auto cursor = std::min(preedit_.cursor(), limit);
+        appendPreedit(str, 0, cursor);
+        limit -= cursor;
+        char buf[FCITX_UTF8_MAX_LENGTH + 1];
+        for (; hic_preedit && *hic_preedit && limit; ++hic_preedit, --limit) {
+            str.append(buf, fcitx_ucs4_to_utf8(*hic_preedit, buf));
+        }
+        appendPreedit(str, cursor,
+                      cursor + std::min(limit, preedit_.size() - cursor));
+    }
+
+    void commitPreedit() {
+        if (!preedit_.empty()) {
+            auto &text = buffer_;
+            text.assign(preedit_.textBefore()).append(preedit_.textAfter());
+            commit(text);
+        }
+        clearPreedit();
+    }
+
+    void erasePreedit(size_t n) { preedit_.eraseFront(n); }
+
+    void clearPreedit() { preedit_.clear(); }
+
     HangulEngine *engine_;
     InputContext *ic_;
+    // Created on demand by prepareContext(), and released when idle.
     UniqueCPtr<HangulInputContext, &hangul_ic_delete> context_;
-    UniqueCPtr<HanjaList, &hanja_list_delete> hanjaList_;
-    std::u32string preedit_;
+    std::unique_ptr<HangulAutomaton> automaton_;
+    uint64_t lastActive_ = 0;
+    uint64_t keyboardGeneration_ = 0;
+    HanjaMatches hanjaList_;
+    HanjaPrefixCursor tableCursor_;
+    // Result of the last lookup, reused while the key stays the same.
+    struct PrecomputedLookup {
+        bool valid = false;
+        std::string key;
+        LookupMethod method = LookupMethod::LOOKUP_METHOD_PREFIX;
+        HanjaMatches list;
+    } precomputed_;
+    // Set when the lookup for the last key is left to onIdle().
+    bool lookupPending_ = false;
+    std::unique_ptr<EventSource> precomputeEvent_;
+    PreeditBuffer preedit_;
+    // Scratch buffers reused by every key.
+    std::string buffer_;
+    std::string lookupKey_;
+    // Key and method that hanjaList_ is looked up with.
+    std::string hanjaListKey_;
     LookupMethod lastLookupMethod_;
+
+    // What is currently shown by input panel.
+    bool uiValid_ = false;
+    bool candidateChanged_ = false;
+    bool lastClientPreedit_ = false;
+    std::string lastPreedit_;
+    std::string lastHicPreedit_;
+    std::string lastPreeditAfter_;
+    const CandidateList *lastCandidateList_ = nullptr;
+
+    // Set by processKeys.
+    bool batching_ = false;
+    bool uiPending_ = false;
+    std::string pendingCommit_;
 };
 
 HangulEngine::HangulEngine(Instance *instance)
     : instance_(instance),
-      factory_([this](InputContext &ic) { return new HangulState(this, &ic); }),
-      table_(loadTable()) {
-    if (!table_) {
-        throw std::runtime_error("Failed to load hanja table.");
-    }
-
-    auto file = StandardPaths::global().locate(StandardPathsType::PkgData,
-                                               "hangul/symbol.txt");
-    if (!file.empty()) {
-        symbolTable_.reset(hanja_table_load(file.string().c_str()));
-    }
-
+      factory_(
+          [this](InputContext &ic) { return new HangulState(this, &ic); }) {
+    // Register first, reloadConfig may update the state of input contexts.
+    instance_->inputContextManager().registerProperty("hangulState", &factory_);
     reloadConfig();
     action_.connect<SimpleAction::Activated>([this](InputContext *ic) {
         config_.hanjaMode.setValue(!*config_.hanjaMode);
+        if (*config_.hanjaMode) {
+            prepareTables(false);
+        }
         updateAction(ic);
+        saveConfigLater();
     });
     instance_->userInterfaceManager().registerAction("hangul", &action_);
-
-    instance_->inputContextManager().registerProperty("hangulState", &factory_);
+    dispatcher_.attach(&instance_->eventLoop());
 }
 
+HangulEngine::~HangulEngine() { saveConfig(); }
+
 void HangulEngine::activate(const InputMethodEntry & /*entry*/,
                             InputContextEvent &event) {
     event.inputContext()->statusArea().addAction(StatusGroup::InputMethod,
                                                  &action_);
+    // Other input methods may have touched the input panel in between.
+    event.inputContext()->propertyFor(&factory_)->invalidateUI();
+    // Hanja mode looks up on every key, so start loading tables early.
+    if (*config_.hanjaMode) {
+        prepareTables(false);
+    }
     updateAction(event.inputContext());
 }
 
@@ -675,15 +1386,353 @@ void HangulEngine::reset(const InputMethodEntry & /*entry*/,
     state->reset();
 }
 
-void HangulEngine::reloadConfig() { readAsIni(config_, "conf/hangul.conf"); }
+void HangulEngine::reloadConfig() {
+    updateConfig([this]() { readAsIni(config_, "conf/hangul.conf"); });
+    // Otherwise it is read together with the tables.
+    if (tablesLoaded_) {
+        reloadUserDictionary();
+    }
+}
+
+void HangulEngine::updateConfig(const std::function<void()> &load) {
+    auto keyboard = *config_.keyboard;
+    const auto *layout = automatonLayout();
+    auto autoReorder = *config_.autoReorder;
+#if defined(FCITX_HANGUL_VERSION_0_2)
+    std::tuple<bool, bool> options{*config_.combiOnDoubleStroke,
+                                   *config_.nonChoseongCombi};
+#endif
+    load();
+    // Contexts pick up the new keyboard on their next key.
+    if (keyboard != *config_.keyboard || layout != automatonLayout()) {
+        keyboardGeneration_++;
+    }
+    bool optionsChanged = autoReorder != *config_.autoReorder;
+#if defined(FCITX_HANGUL_VERSION_0_2)
+    optionsChanged =
+        optionsChanged ||
+        options != std::tuple<bool, bool>{*config_.combiOnDoubleStroke,
+                                          *config_.nonChoseongCombi};
+#endif
+    if (optionsChanged) {
+        instance_->inputContextManager().foreach([this](InputContext *ic) {
+            state(ic)->updateOptions();
+            return true;
+        });
+    }
+    updateKeyCache();
+}
+
+const HangulAutomaton::Layout *HangulEngine::automatonLayout() const {
+    if (!*config_.builtinAutomaton) {
+        return nullptr;
+    }
+#if defined(FCITX_HANGUL_VERSION_0_2)
+    // Not implemented by the automaton.
+    if (!*config_.nonChoseongCombi) {
+        return nullptr;
+    }
+#endif
+    return HangulAutomaton::layout(
+        keyboardId[static_cast<int>(*config_.keyboard)]);
+}
+
+HangulAutomaton::Options HangulEngine::automatonOptions() const {
+    HangulAutomaton::Options options;
+    options.autoReorder = *config_.autoReorder;
+#if defined(FCITX_HANGUL_VERSION_0_2)
+    options.combiOnDoubleStroke = *config_.combiOnDoubleStroke;
+#endif
+    return options;
+}
+
+void HangulEngine::updateKeyCache() {
+    shortcutStates_ = KeyStates();
+    for (const auto *keyList :
+         {&*config_.hanjaModeToggleKey, &*config_.prevPageKey,
+          &*config_.nextPageKey, &*config_.prevCandidateKey,
+          &*config_.nextCandidateKey}) {
+        for (auto key : *keyList) {
+            shortcutStates_ |= key.states();
+        }
+    }
+
+    // libhangul only takes ascii, and whether a key is taken depends only on
+    // the keyboard, so feed every key to an empty context once.
+    handledKeys_.reset();
+    UniqueCPtr<HangulInputContext, &hangul_ic_delete> context(hangul_ic_new(
+        keyboardId[static_cast<int>(*config_.keyboard)]));
+    for (size_t i = 0; i < handledKeys_.size(); i++) {
+        hangul_ic_reset(context.get());
+        bool used = hangul_ic_process(context.get(), static_cast<int>(i));
+        const auto *commit = hangul_ic_get_commit_string(context.get());
+        if (used || !hangul_ic_is_empty(context.get()) ||
+            (commit && commit[0])) {
+            handledKeys_.set(i);
+        }
+    }
+}
+
+void HangulEngine::save() {
+    saveConfig();
+    if (tables_.history) {
+        tables_.history->compact();
+    }
+}
+
+void HangulEngine::addHistory(std::string_view key, std::string_view value,
+                              uint32_t index) {
+    if (!tables_.history) {
+        return;
+    }
+    tables_.history->add(key, value, index);
+    // Compacting rewrites the whole table, so it's left out of the key event.
+    if (tables_.history->needCompact()) {
+        saveLater();
+    }
+}
+
+void HangulEngine::saveConfigLater() {
+    configDirty_ = true;
+    saveLater();
+}
+
+void HangulEngine::saveLater() {
+    if (saveEvent_ && saveEvent_->isEnabled()) {
+        return;
+    }
+    auto time = now(CLOCK_MONOTONIC) + CONFIG_SAVE_DELAY;
+    if (saveEvent_) {
+        saveEvent_->setTime(time);
+        saveEvent_->setOneShot();
+        return;
+    }
+    saveEvent_ = instance_->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, time, 0, [this](EventSourceTime *, uint64_t) {
+            saveConfig();
+            if (tables_.history && tables_.history->needCompact()) {
+                tables_.history->compact();
+            }
+            return true;
+        });
+}
+
+void HangulEngine::scheduleReleaseIdle() {
+    if (*config_.idleReleaseTime <= 0 ||
+        (releaseIdleEvent_ && releaseIdleEvent_->isEnabled())) {
+        return;
+    }
+    auto time = now(CLOCK_MONOTONIC) +
+                static_cast<uint64_t>(*config_.idleReleaseTime) * 1000000;
+    if (releaseIdleEvent_) {
+        releaseIdleEvent_->setTime(time);
+        releaseIdleEvent_->setOneShot();
+        return;
+    }
+    releaseIdleEvent_ = instance_->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, time, 0, [this](EventSourceTime *, uint64_t) {
+            releaseIdle();
+            return true;
+        });
+}
+
+void HangulEngine::releaseIdle() {
+    if (*config_.idleReleaseTime <= 0) {
+        return;
+    }
+    auto current = now(CLOCK_MONOTONIC);
+    uint64_t idle = static_cast<uint64_t>(*config_.idleReleaseTime) * 1000000;
+    auto idleSince = current > idle ? current - idle : 0;
+    bool pending = false;
+    instance_->inputContextManager().foreach(
+        [this, idleSince, &pending](InputContext *ic) {
+            if (!state(ic)->releaseIfIdle(idleSince)) {
+                pending = true;
+            }
+            return true;
+        });
+    // Check again later if some context is still in use, otherwise the timer
+    // is started again when a context is created.
+    if (pending) {
+        releaseIdleEvent_->setTime(current + idle);
+        releaseIdleEvent_->setOneShot();
+    }
+}
+
+void HangulEngine::saveConfig() {
+    if (!configDirty_) {
+        return;
+    }
+    configDirty_ = false;
+    safeSaveAsIni(config_, "conf/hangul.conf");
+}
 
 void HangulEngine::setConfig(const fcitx::RawConfig &rawConfig) {
-    config_.load(rawConfig, true);
-    instance_->inputContextManager().foreach([this](InputContext *ic) {
-        state(ic)->configure();
+    updateConfig([this, &rawConfig]() { config_.load(rawConfig, true); });
+    saveConfigLater();
+}
+
+bool HangulEngine::prepareTables(bool wait) {
+    if (tablesLoaded_) {
         return true;
+    }
+    if (!tablesFuture_.valid()) {
+        tablesFuture_ = std::async(std::launch::async, []() {
+            HangulTables tables;
+            tables.table = loadTable();
+            tables.history = loadHistory();
+            tables.userDictionary = UserDictionary().diff(
+                UserDictionary::read(userDictionaryPath()));
+            return tables;
+        });
+    }
+    if (!wait && tablesFuture_.wait_for(std::chrono::seconds(0)) !=
+                     std::future_status::ready) {
+        return false;
+    }
+    tables_ = tablesFuture_.get();
+    tablesLoaded_ = true;
+    if (!tables_.table) {
+        HANGUL_WARN() << "Failed to load hanja table.";
+    }
+    userDict_.apply(std::move(tables_.userDictionary));
+    watchUserDictionary();
+    // The file may have changed after it was read and before it was watched.
+    if (userDictWatch_) {
+        reloadUserDictionary();
+    }
+    return true;
+}
+
+void HangulEngine::matchUserDictionary(std::string_view key,
+                                       LookupMethod method,
+                                       HanjaMatches &list) const {
+    switch (method) {
+    case LookupMethod::LOOKUP_METHOD_PREFIX:
+        userDict_.matchPrefix(key, list);
+        break;
+    case LookupMethod::LOOKUP_METHOD_EXACT:
+        userDict_.matchExact(key, list);
+        break;
+    case LookupMethod::LOOKUP_METHOD_SUFFIX:
+        userDict_.matchSuffix(key, list);
+        break;
+    }
+}
+
+// The directory is watched instead of the file, so the file is still picked
+// up after it is created, or replaced by an editor.
+void HangulEngine::watchUserDictionary() {
+    auto dir =
+        StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+        "hangul";
+    auto fd = UnixFD::own(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (!fd.isValid() || !fs::makePath(dir) ||
+        inotify_add_watch(fd.fd(), dir.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                              IN_DELETE) < 0) {
+        HANGUL_WARN() << "Failed to watch " << dir.string()
+                      << ", user dictionary is only reloaded with config.";
+        return;
+    }
+    userDictWatchFd_ = std::move(fd);
+    userDictWatch_ = instance_->eventLoop().addIOEvent(
+        userDictWatchFd_.fd(), IOEventFlag::In,
+        [this](EventSourceIO *, int fd, IOEventFlags) {
+            alignas(struct inotify_event) char buffer[4096];
+            bool changed = false;
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+                for (ssize_t pos = 0; pos < length;) {
+                    const auto *event =
+                        reinterpret_cast<const struct inotify_event *>(
+                            buffer + pos);
+                    if (event->len &&
+                        USER_DICTIONARY_FILE == std::string_view(event->name)) {
+                        changed = true;
+                    }
+                    pos += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            if (changed) {
+                reloadUserDictionary();
+            }
+            return true;
+        });
+}
+
+void HangulEngine::reloadUserDictionary() {
+    // The running reload compares with the dictionary before the new change,
+    // so start another one after it is applied.
+    if (userDictLoading_) {
+        userDictReloadPending_ = true;
+        return;
+    }
+    userDictLoading_ = true;
+    userDictFuture_ = std::async(std::launch::async, [this]() {
+        auto changes =
+            userDict_.diff(UserDictionary::read(userDictionaryPath()));
+        dispatcher_.schedule([this, changes = std::move(changes)]() mutable {
+            applyUserDictionary(std::move(changes));
+        });
     });
-    safeSaveAsIni(config_, "conf/hangul.conf");
+}
+
+void HangulEngine::applyUserDictionary(
+    std::vector<UserDictionary::Change> changes) {
+    userDictLoading_ = false;
+    if (!changes.empty()) {
+        HANGUL_DEBUG() << "Updating " << changes.size()
+                       << " keys of user dictionary";
+        userDict_.apply(std::move(changes));
+        instance_->inputContextManager().foreach([this](InputContext *ic) {
+            state(ic)->dictionaryChanged();
+            return true;
+        });
+    }
+    if (userDictReloadPending_) {
+        userDictReloadPending_ = false;
+        reloadUserDictionary();
+    }
+}
+
+std::string HangulEngine::dumpLatency(bool reset) {
+    auto report = latency_.report();
+    FCITX_LOGC(hangul_latency, Info) << "Key handling latency:\n" << report;
+    if (reset) {
+        latency_.reset();
+    }
+    return report;
+}
+
+void HangulEngine::processKeys(InputContext *ic, const std::vector<Key> &keys) {
+    state(ic)->processKeys(keys);
+}
+
+void HangulEngine::runIdle(InputContext *ic) { state(ic)->runIdle(); }
+
+std::vector<HangulDictionaryEntry>
+HangulEngine::lookupExact(std::string_view key) {
+    prepareTables(true);
+    auto list = table() ? table()->matchExact(key) : HanjaMatches();
+    userDict_.matchExact(key, list);
+    return toEntries(list);
+}
+
+std::vector<HangulDictionaryEntry>
+HangulEngine::lookupPrefix(std::string_view key) {
+    prepareTables(true);
+    auto list = table() ? table()->matchPrefix(key) : HanjaMatches();
+    userDict_.matchPrefix(key, list);
+    return toEntries(list);
+}
+
+std::vector<HangulDictionaryEntry>
+HangulEngine::lookupSuffix(std::string_view key) {
+    prepareTables(true);
+    auto list = table() ? table()->matchSuffix(key) : HanjaMatches();
+    userDict_.matchSuffix(key, list);
+    return toEntries(list);
 }
 
 HangulState *HangulEngine::state(InputContext *ic) {
@@ -7,16 +7,28 @@
 #ifndef _FCITX5_HANGUL_ENGINE_H_
 #define _FCITX5_HANGUL_ENGINE_H_
 
+#include "hangul_public.h"
+#include "hangulautomaton.h"
+#include "hanjadict.h"
+#include "latency.h"
+#include "userdict.h"
+#include "userhistory.h"
+#include <algorithm>
+#include <bitset>
 #include <cstdint>
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
 #include <fcitx-config/iniparser.h>
 #include <fcitx-config/option.h>
 #include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/event.h>
+#include <fcitx-utils/eventdispatcher.h>
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
+#include <fcitx-utils/log.h>
 #include <fcitx-utils/misc.h>
+#include <fcitx-utils/unixfd.h>
 #include <fcitx/action.h>
 #include <fcitx/addonfactory.h>
 #include <fcitx/addoninstance.h>
@@ -25,11 +37,20 @@
 #include <fcitx/inputcontextproperty.h>
 #include <fcitx/inputmethodengine.h>
 #include <fcitx/instance.h>
+#include <functional>
+#include <future>
 #include <hangul.h>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace fcitx {
 
+FCITX_DECLARE_LOG_CATEGORY(hangul_log);
+#define HANGUL_DEBUG() FCITX_LOGC(::fcitx::hangul_log, Debug)
+#define HANGUL_WARN() FCITX_LOGC(::fcitx::hangul_log, Warn)
+
 enum class HangulKeyboard {
     Dubeolsik = 0,
     Dubeolsik_Yetgeul,
@@ -93,8 +114,18 @@ FCITX_CONFIGURATION(
     Option<bool> nonChoseongCombi{this, "NonChoseongCombi",
                                   _("Combine Non Choseong"), true};
 #endif
+    // Only Dubeolsik and Sebeolsik Final are built in, other layouts always
+    // use libhangul.
+    Option<bool> builtinAutomaton{
+        this, "BuiltinAutomaton",
+        _("Use built-in composition for Dubeolsik and Sebeolsik Final"),
+        false};
     Option<bool> wordCommit{this, "WordCommit", _("Word Commit"), false};
-    Option<bool> hanjaMode{this, "HanjaMode", _("Hanja Mode"), false};);
+    Option<bool> hanjaMode{this, "HanjaMode", _("Hanja Mode"), false};
+    Option<int, IntConstrain> idleReleaseTime{
+        this, "IdleReleaseTime",
+        _("Free unused input state after idle seconds (0 to disable)"), 300,
+        IntConstrain(0)};);
 
 enum class LookupMethod : uint8_t {
     LOOKUP_METHOD_PREFIX,
@@ -104,9 +135,18 @@ enum class LookupMethod : uint8_t {
 
 class HangulState;
 
+struct HangulTables {
+    // Symbols and hanja.
+    std::unique_ptr<HanjaDictionary> table;
+    std::unique_ptr<UserHistory> history;
+    // Initial content of the user dictionary.
+    std::vector<UserDictionary::Change> userDictionary;
+};
+
 class HangulEngine : public InputMethodEngine {
 public:
     HangulEngine(Instance *instance);
+    ~HangulEngine();
 
     void activate(const fcitx::InputMethodEntry &,
                   fcitx::InputContextEvent &) override;
@@ -117,6 +157,7 @@ public:
     void reset(const fcitx::InputMethodEntry &,
                fcitx::InputContextEvent &) override;
     void reloadConfig() override;
+    void save() override;
 
     const fcitx::Configuration *getConfig() const override { return &config_; }
 
@@ -124,11 +165,38 @@ public:
 
     auto &config() { return config_; }
 
-    auto table() { return table_.get(); }
-    auto symbolTable() { return symbolTable_.get(); }
+    // Tables are loaded by a background thread on first use. Return false if
+    // they are not ready yet and wait is false.
+    bool prepareTables(bool wait);
+    // Whether loading the tables is started, without starting it.
+    bool tablesRequested() const {
+        return tablesLoaded_ || tablesFuture_.valid();
+    }
+    const HanjaDictionary *table() const { return tables_.table.get(); }
+
+    // Longest key of the tables in characters, 0 if not loaded.
+    size_t maxKeyLength() const {
+        return std::max(tables_.table ? tables_.table->maxKeyLength() : 0,
+                        userDict_.maxKeyLength());
+    }
+    // Put the entries of user dictionary on top of list, which is matched
+    // from the tables with key and method.
+    void matchUserDictionary(std::string_view key, LookupMethod method,
+                             HanjaMatches &list) const;
+    const UserHistory *history() const { return tables_.history.get(); }
+    // Remember the selected candidate, value is the index-th entry of key.
+    void addHistory(std::string_view key, std::string_view value,
+                    uint32_t index);
 
     HangulState *state(InputContext *ic);
 
+    // Modifiers used by any of the configured key lists.
+    KeyStates shortcutStates() const { return shortcutStates_; }
+    // Whether the current keyboard layout may consume sym.
+    bool isKeyHandled(KeySym sym) const {
+        return sym < handledKeys_.size() && handledKeys_.test(sym);
+    }
+
     void updateAction(InputContext *ic) {
         action_.setIcon(*config_.hanjaMode ? "fcitx-hanja-active"
                                            : "fcitx-hanja-inactive");
@@ -137,18 +205,75 @@ public:
         action_.setShortText(*config_.hanjaMode ? "\xe9\x9f\x93"
                                                 : "\xed\x95\x9c");
         action_.update(ic);
-        safeSaveAsIni(config_, "conf/hangul.conf");
     }
 
+    // Config is written by a timer, so repeated changes only write once.
+    void saveConfigLater();
+    // Bumped when keyboard layout is changed.
+    uint64_t keyboardGeneration() const { return keyboardGeneration_; }
+    // Built-in layout to compose with instead of libhangul, or nullptr.
+    const HangulAutomaton::Layout *automatonLayout() const;
+    HangulAutomaton::Options automatonOptions() const;
+
+    // Start the timer to release the state of idle input contexts.
+    void scheduleReleaseIdle();
+
     auto instance() { return instance_; }
 
+    LatencyStats &latency() { return latency_; }
+    std::string dumpLatency(bool reset);
+    void processKeys(InputContext *ic, const std::vector<Key> &keys);
+    void runIdle(InputContext *ic);
+    std::vector<HangulDictionaryEntry> lookupExact(std::string_view key);
+    std::vector<HangulDictionaryEntry> lookupPrefix(std::string_view key);
+    std::vector<HangulDictionaryEntry> lookupSuffix(std::string_view key);
+
 private:
+    void saveConfig();
+    // Save config if changed and compact history if needed, by a timer.
+    void saveLater();
+    // Load config with load, and apply the changes to existing contexts.
+    void updateConfig(const std::function<void()> &load);
+    void updateKeyCache();
+    void releaseIdle();
+    void watchUserDictionary();
+    // Read the user dictionary in a background thread, and apply the changes
+    // on the main thread once it is done.
+    void reloadUserDictionary();
+    void applyUserDictionary(std::vector<UserDictionary::Change> changes);
+
     Instance *instance_;
     HangulConfig config_;
+    bool configDirty_ = false;
+    std::unique_ptr<EventSourceTime> saveEvent_;
+    std::unique_ptr<EventSourceTime> releaseIdleEvent_;
     FactoryFor<HangulState> factory_;
-    UniqueCPtr<HanjaTable, hanja_table_delete> table_;
-    UniqueCPtr<HanjaTable, hanja_table_delete> symbolTable_;
+    HangulTables tables_;
+    std::future<HangulTables> tablesFuture_;
+    bool tablesLoaded_ = false;
+    KeyStates shortcutStates_;
+    uint64_t keyboardGeneration_ = 0;
+    std::bitset<128> handledKeys_;
     SimpleAction action_;
+    LatencyStats latency_;
+    // Only modified on the main thread while no reload is running, the reload
+    // thread compares the file with it.
+    UserDictionary userDict_;
+    EventDispatcher dispatcher_;
+    UnixFD userDictWatchFd_;
+    std::unique_ptr<EventSourceIO> userDictWatch_;
+    bool userDictLoading_ = false;
+    bool userDictReloadPending_ = false;
+    // Destroyed first, so the reload thread is finished before what it uses
+    // goes away.
+    std::future<void> userDictFuture_;
+
+    FCITX_ADDON_EXPORT_FUNCTION(HangulEngine, dumpLatency);
+    FCITX_ADDON_EXPORT_FUNCTION(HangulEngine, processKeys);
+    FCITX_ADDON_EXPORT_FUNCTION(HangulEngine, runIdle);
+    FCITX_ADDON_EXPORT_FUNCTION(HangulEngine, lookupExact);
+    FCITX_ADDON_EXPORT_FUNCTION(HangulEngine, lookupPrefix);
+    FCITX_ADDON_EXPORT_FUNCTION(HangulEngine, lookupSuffix);
 };
 
 class HangulEngineFactory : public AddonFactory {
@@ -0,0 +1,65 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_HANGUL_HANGUL_PUBLIC_H_
+#define _FCITX5_HANGUL_HANGUL_PUBLIC_H_
+
+#include <fcitx-utils/key.h>
+#include <fcitx/addoninstance.h>
+#include <fcitx/inputcontext.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fcitx {
+
+// An entry of the dictionary loaded by the hangul addon. The strings point
+// into the dictionary itself, and are only valid until control returns to
+// the event loop, since the dictionary may be reloaded after that.
+struct HangulDictionaryEntry {
+    std::string_view key;
+    std::string_view value;
+    std::string_view comment;
+};
+
+} // namespace fcitx
+
+// Write the key handling latency collected so far to the hangul_latency log
+// category and return it. Latency is only collected when hangul_latency is
+// at debug level. If reset is true, the collected latency is cleared.
+FCITX_ADDON_DECLARE_FUNCTION(HangulEngine, dumpLatency, std::string(bool reset));
+
+// Type keys in the input context as a batch, e.g. for pasted or automated
+// input. Text committed by the keys is sent as one string, and the preedit
+// is only updated once at the end. Printable keys not used by the engine are
+// included in the committed text, other keys are forwarded to the
+// application.
+FCITX_ADDON_DECLARE_FUNCTION(HangulEngine, processKeys,
+                             void(InputContext *ic,
+                                  const std::vector<Key> &keys));
+
+// Do the work the input context left to be done when the event loop is idle,
+// e.g. a deferred hanja lookup, without waiting for the event loop. Meant for
+// benchmarks that type keys without returning to the event loop.
+FCITX_ADDON_DECLARE_FUNCTION(HangulEngine, runIdle, void(InputContext *ic));
+
+// Look up the symbol and hanja dictionary of the addon, so other addons don't
+// need to load their own copy. Entries of the user dictionary come first,
+// then symbols and hanja of the same key.
+// Prefix and suffix lookups match every prefix or suffix of key, the longest
+// one first. The dictionary is loaded on the first call if it is not loaded
+// yet, which blocks until it is done.
+FCITX_ADDON_DECLARE_FUNCTION(
+    HangulEngine, lookupExact,
+    std::vector<HangulDictionaryEntry>(std::string_view key));
+FCITX_ADDON_DECLARE_FUNCTION(
+    HangulEngine, lookupPrefix,
+    std::vector<HangulDictionaryEntry>(std::string_view key));
+FCITX_ADDON_DECLARE_FUNCTION(
+    HangulEngine, lookupSuffix,
+    std::vector<HangulDictionaryEntry>(std::string_view key));
+
+#endif // _FCITX5_HANGUL_HANGUL_PUBLIC_H_
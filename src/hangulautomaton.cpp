@@ -0,0 +1,532 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+
+#include "hangulautomaton.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <span>
+#include <tuple>
+#include <utility>
+
+namespace fcitx {
+
+namespace {
+
+constexpr uint32_t choseongFiller = 0x115f;
+constexpr uint32_t jungseongFiller = 0x1160;
+
+constexpr bool isChoseong(uint32_t c) { return c >= 0x1100 && c <= 0x115f; }
+constexpr bool isJungseong(uint32_t c) { return c >= 0x1160 && c <= 0x11a7; }
+constexpr bool isJongseong(uint32_t c) { return c >= 0x11a8 && c <= 0x11ff; }
+constexpr bool isJamo(uint32_t c) { return c >= 0x1100 && c <= 0x11ff; }
+
+// Modern jamo, the only ones typed by built in layouts.
+constexpr bool isModernChoseong(uint32_t c) {
+    return c >= 0x1100 && c <= 0x1112;
+}
+constexpr bool isModernJungseong(uint32_t c) {
+    return c >= 0x1161 && c <= 0x1175;
+}
+constexpr bool isModernJongseong(uint32_t c) {
+    return c >= 0x11a8 && c <= 0x11c2;
+}
+
+constexpr std::array<uint32_t, 0x13> choseongToCompat{
+    0x3131, 0x3132, 0x3134, 0x3137, 0x3138, 0x3139, 0x3141,
+    0x3142, 0x3143, 0x3145, 0x3146, 0x3147, 0x3148, 0x3149,
+    0x314a, 0x314b, 0x314c, 0x314d, 0x314e};
+
+constexpr std::array<uint32_t, 0x1b> jongseongToCompat{
+    0x3131, 0x3132, 0x3133, 0x3134, 0x3135, 0x3136, 0x3137,
+    0x3139, 0x313a, 0x313b, 0x313c, 0x313d, 0x313e, 0x313f,
+    0x3140, 0x3141, 0x3142, 0x3144, 0x3145, 0x3146, 0x3147,
+    0x3148, 0x314a, 0x314b, 0x314c, 0x314d, 0x314e};
+
+// 0 if the choseong can't be jongseong.
+constexpr std::array<uint32_t, 0x13> choseongToJongseong{
+    0x11a8, 0x11a9, 0x11ab, 0x11ae, 0,      0x11af, 0x11b7,
+    0x11b8, 0,      0x11ba, 0x11bb, 0x11bc, 0x11bd, 0,
+    0x11be, 0x11bf, 0x11c0, 0x11c1, 0x11c2};
+
+// The last part of the jongseong, as choseong.
+constexpr std::array<uint32_t, 0x1b> jongseongToChoseong{
+    0x1100, 0x1101, 0x1109, 0x1102, 0x110c, 0x1112, 0x1103,
+    0x1105, 0x1100, 0x1106, 0x1107, 0x1109, 0x1110, 0x1111,
+    0x1112, 0x1106, 0x1107, 0x1109, 0x1109, 0x110a, 0x110b,
+    0x110c, 0x110e, 0x110f, 0x1110, 0x1111, 0x1112};
+
+// Split jongseong to the part left as jongseong and the part moved to the
+// next syllable as choseong.
+constexpr std::array<std::pair<uint32_t, uint32_t>, 0x1b> jongseongSplit{{
+    {0, 0x1100},      {0, 0x1101},      {0x11a8, 0x1109}, {0, 0x1102},
+    {0x11ab, 0x110c}, {0x11ab, 0x1112}, {0, 0x1103},      {0, 0x1105},
+    {0x11af, 0x1100}, {0x11af, 0x1106}, {0x11af, 0x1107}, {0x11af, 0x1109},
+    {0x11af, 0x1110}, {0x11af, 0x1111}, {0x11af, 0x1112}, {0, 0x1106},
+    {0, 0x1107},      {0x11b8, 0x1109}, {0, 0x1109},      {0, 0x110a},
+    {0, 0x110b},      {0, 0x110c},      {0, 0x110e},      {0, 0x110f},
+    {0, 0x1110},      {0, 0x1111},      {0, 0x1112},
+}};
+
+constexpr uint32_t toCompat(uint32_t c) {
+    if (isModernChoseong(c)) {
+        return choseongToCompat[c - 0x1100];
+    }
+    if (isModernJungseong(c)) {
+        return 0x314f + (c - 0x1161);
+    }
+    if (isModernJongseong(c)) {
+        return jongseongToCompat[c - 0x11a8];
+    }
+    return c;
+}
+
+struct Combination {
+    uint32_t key;
+    uint32_t value;
+
+    constexpr bool operator<(const Combination &other) const {
+        return key < other.key;
+    }
+};
+
+constexpr uint32_t combinationKey(uint32_t first, uint32_t second) {
+    return (first << 16) | second;
+}
+
+using Keymap = std::array<uint32_t, 128>;
+
+// Printable ascii types itself unless the layout assigns a jamo. Upper case
+// letters type the same as lower case unless assigned.
+constexpr Keymap
+makeKeymap(std::initializer_list<std::pair<char, uint32_t>> jamo) {
+    Keymap keymap{};
+    for (size_t c = 0x21; c < 0x7f; c++) {
+        keymap[c] = c;
+    }
+    for (auto [key, value] : jamo) {
+        keymap[static_cast<unsigned char>(key)] = value;
+        if (key >= 'a' && key <= 'z') {
+            keymap[key - 'a' + 'A'] = value;
+        }
+    }
+    for (auto [key, value] : jamo) {
+        if (key >= 'A' && key <= 'Z') {
+            keymap[static_cast<unsigned char>(key)] = value;
+        }
+    }
+    return keymap;
+}
+
+template <size_t N>
+constexpr std::array<Combination, N>
+makeCombinations(const Combination (&items)[N]) {
+    std::array<Combination, N> result{};
+    std::copy(std::begin(items), std::end(items), result.begin());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+constexpr Keymap dubeolsikKeymap = makeKeymap({
+    {'q', 0x1107}, {'w', 0x110c}, {'e', 0x1103}, {'r', 0x1100},
+    {'t', 0x1109}, {'y', 0x116d}, {'u', 0x1167}, {'i', 0x1163},
+    {'o', 0x1162}, {'p', 0x1166}, {'a', 0x1106}, {'s', 0x1102},
+    {'d', 0x110b}, {'f', 0x1105}, {'g', 0x1112}, {'h', 0x1169},
+    {'j', 0x1165}, {'k', 0x1161}, {'l', 0x1175}, {'z', 0x110f},
+    {'x', 0x1110}, {'c', 0x110e}, {'v', 0x1111}, {'b', 0x1172},
+    {'n', 0x116e}, {'m', 0x1173}, {'Q', 0x1108}, {'W', 0x110d},
+    {'E', 0x1104}, {'R', 0x1101}, {'T', 0x110a}, {'O', 0x1164},
+    {'P', 0x1168},
+});
+
+// Same as hangul_keyboard_table_3final of libhangul, every printable key is
+// assigned.
+constexpr Keymap sebeolsikFinalKeymap = makeKeymap({
+    {'!', 0x11a9}, {'"', 0x00b7}, {'#', 0x11bd}, {'$', 0x11b5},
+    {'%', 0x11b4}, {'&', 0x201c}, {'\'', 0x1110}, {'(', 0x0027},
+    {')', 0x007e}, {'*', 0x201d}, {'+', 0x002b}, {',', 0x002c},
+    {'-', 0x0029}, {'.', 0x002e}, {'/', 0x1169}, {'0', 0x110f},
+    {'1', 0x11c2}, {'2', 0x11bb}, {'3', 0x11b8}, {'4', 0x116d},
+    {'5', 0x1172}, {'6', 0x1163}, {'7', 0x1168}, {'8', 0x1174},
+    {'9', 0x116e}, {':', 0x0034}, {';', 0x1107}, {'<', 0x002c},
+    {'=', 0x003e}, {'>', 0x002e}, {'?', 0x0021}, {'@', 0x11b0},
+    {'A', 0x11ae}, {'B', 0x003f}, {'C', 0x11bf}, {'D', 0x11b2},
+    {'E', 0x11ac}, {'F', 0x11b1}, {'G', 0x1164}, {'H', 0x0030},
+    {'I', 0x0037}, {'J', 0x0031}, {'K', 0x0032}, {'L', 0x0033},
+    {'M', 0x0022}, {'N', 0x002d}, {'O', 0x0038}, {'P', 0x0039},
+    {'Q', 0x11c1}, {'R', 0x11b6}, {'S', 0x11ad}, {'T', 0x11b3},
+    {'U', 0x0036}, {'V', 0x11aa}, {'W', 0x11c0}, {'X', 0x11b9},
+    {'Y', 0x0035}, {'Z', 0x11be}, {'[', 0x0028}, {'\\', 0x003a},
+    {']', 0x003c}, {'^', 0x003d}, {'_', 0x003b}, {'`', 0x002a},
+    {'a', 0x11bc}, {'b', 0x116e}, {'c', 0x1166}, {'d', 0x1175},
+    {'e', 0x1167}, {'f', 0x1161}, {'g', 0x1173}, {'h', 0x1102},
+    {'i', 0x1106}, {'j', 0x110b}, {'k', 0x1100}, {'l', 0x110c},
+    {'m', 0x1112}, {'n', 0x1109}, {'o', 0x110e}, {'p', 0x1111},
+    {'q', 0x11ba}, {'r', 0x1162}, {'s', 0x11ab}, {'t', 0x1165},
+    {'u', 0x1103}, {'v', 0x1169}, {'w', 0x11af}, {'x', 0x11a8},
+    {'y', 0x1105}, {'z', 0x11b7}, {'{', 0x0025}, {'|', 0x005c},
+    {'}', 0x002f}, {'~', 0x203b},
+});
+
+// Same as the default combination of libhangul, used by both layouts.
+constexpr Combination defaultCombinationItems[] = {
+    {combinationKey(0x1100, 0x1100), 0x1101},
+    {combinationKey(0x1103, 0x1103), 0x1104},
+    {combinationKey(0x1107, 0x1107), 0x1108},
+    {combinationKey(0x1109, 0x1109), 0x110a},
+    {combinationKey(0x110c, 0x110c), 0x110d},
+    {combinationKey(0x1169, 0x1161), 0x116a},
+    {combinationKey(0x1169, 0x1162), 0x116b},
+    {combinationKey(0x1169, 0x1175), 0x116c},
+    {combinationKey(0x116e, 0x1165), 0x116f},
+    {combinationKey(0x116e, 0x1166), 0x1170},
+    {combinationKey(0x116e, 0x1175), 0x1171},
+    {combinationKey(0x1173, 0x1175), 0x1174},
+    {combinationKey(0x11a8, 0x11a8), 0x11a9},
+    {combinationKey(0x11a8, 0x11ba), 0x11aa},
+    {combinationKey(0x11ab, 0x11bd), 0x11ac},
+    {combinationKey(0x11ab, 0x11c2), 0x11ad},
+    {combinationKey(0x11af, 0x11a8), 0x11b0},
+    {combinationKey(0x11af, 0x11b7), 0x11b1},
+    {combinationKey(0x11af, 0x11b8), 0x11b2},
+    {combinationKey(0x11af, 0x11ba), 0x11b3},
+    {combinationKey(0x11af, 0x11c0), 0x11b4},
+    {combinationKey(0x11af, 0x11c1), 0x11b5},
+    {combinationKey(0x11af, 0x11c2), 0x11b6},
+    {combinationKey(0x11b8, 0x11ba), 0x11b9},
+    {combinationKey(0x11ba, 0x11ba), 0x11bb},
+};
+
+constexpr auto defaultCombination = makeCombinations(defaultCombinationItems);
+
+static_assert(dubeolsikKeymap['r'] == 0x1100 && dubeolsikKeymap['R'] == 0x1101);
+static_assert(dubeolsikKeymap['K'] == 0x1161 && dubeolsikKeymap['1'] == '1');
+static_assert(sebeolsikFinalKeymap['k'] == 0x1100 &&
+              sebeolsikFinalKeymap['x'] == 0x11a8 &&
+              sebeolsikFinalKeymap['X'] == 0x11b9);
+static_assert(std::adjacent_find(defaultCombination.begin(),
+                                 defaultCombination.end(),
+                                 [](const auto &a, const auto &b) {
+                                     return a.key == b.key;
+                                 }) == defaultCombination.end());
+
+} // namespace
+
+struct HangulAutomaton::Layout {
+    std::string_view id;
+    // Same as HANGUL_KEYBOARD_TYPE_JASO, choseong, jungseong and jongseong
+    // have keys of their own.
+    bool jaso;
+    const Keymap &keymap;
+    std::span<const Combination> combination;
+};
+
+namespace {
+
+const HangulAutomaton::Layout layouts[] = {
+    {"2", false, dubeolsikKeymap, defaultCombination},
+    {"3f", true, sebeolsikFinalKeymap, defaultCombination},
+};
+
+} // namespace
+
+const HangulAutomaton::Layout *HangulAutomaton::layout(std::string_view id) {
+    for (const auto &layout : layouts) {
+        if (layout.id == id) {
+            return &layout;
+        }
+    }
+    return nullptr;
+}
+
+HangulAutomaton::HangulAutomaton(const Layout *layout, Options options)
+    : layout_(layout), options_(options) {}
+
+uint32_t HangulAutomaton::combine(uint32_t first, uint32_t second) const {
+    // Typing the same key twice never combines without the option. Jaso
+    // layouts type double consonants that way, so it only applies to jamo
+    // layouts.
+    if (!options_.combiOnDoubleStroke && !layout_->jaso && first == second) {
+        return 0;
+    }
+    auto key = combinationKey(first, second);
+    auto iter =
+        std::lower_bound(layout_->combination.begin(),
+                         layout_->combination.end(), Combination{key, 0});
+    if (iter != layout_->combination.end() && iter->key == key) {
+        return iter->value;
+    }
+    return 0;
+}
+
+bool HangulAutomaton::push(uint32_t c) {
+    if (!isJamo(c)) {
+        return false;
+    }
+    // Without reordering, jamo typed after a later part of the syllable
+    // starts a new syllable.
+    if (!options_.autoReorder &&
+        ((isChoseong(c) && (jungseong_ || jongseong_)) ||
+         (isJungseong(c) && jongseong_))) {
+        flushInternal();
+        return false;
+    }
+    if (index_ + 1 >= static_cast<int>(std::size(stack_))) {
+        return false;
+    }
+    if (isChoseong(c)) {
+        choseong_ = c;
+    } else if (isJungseong(c)) {
+        jungseong_ = c;
+    } else {
+        jongseong_ = c;
+    }
+    stack_[++index_] = c;
+    return true;
+}
+
+uint32_t HangulAutomaton::pop() { return index_ < 0 ? 0 : stack_[index_--]; }
+
+uint32_t HangulAutomaton::peek() const {
+    return index_ < 0 ? 0 : stack_[index_];
+}
+
+void HangulAutomaton::clearBuffer() {
+    choseong_ = jungseong_ = jongseong_ = 0;
+    index_ = -1;
+}
+
+int HangulAutomaton::bufferString(uint32_t *str) const {
+    int n = 0;
+    if (isModernChoseong(choseong_) && isModernJungseong(jungseong_) &&
+        (!jongseong_ || isModernJongseong(jongseong_))) {
+        str[n++] = 0xac00 + (((choseong_ - 0x1100) * 21) +
+                             (jungseong_ - 0x1161)) *
+                                28 +
+                   (jongseong_ ? jongseong_ - 0x11a7 : 0);
+    } else if (!!choseong_ + !!jungseong_ + !!jongseong_ == 1) {
+        // A single jamo is shown as compatibility jamo.
+        str[n++] = toCompat(choseong_ + jungseong_ + jongseong_);
+    } else if (choseong_ || jungseong_) {
+        str[n++] = choseong_ ? choseong_ : choseongFiller;
+        str[n++] = jungseong_ ? jungseong_ : jungseongFiller;
+        if (jongseong_) {
+            str[n++] = jongseong_;
+        }
+    }
+    str[n] = 0;
+    return n;
+}
+
+void HangulAutomaton::saveCommit() {
+    auto *end = commit_;
+    while (*end) {
+        ++end;
+    }
+    bufferString(end);
+    clearBuffer();
+}
+
+void HangulAutomaton::savePreedit() { bufferString(preedit_); }
+
+void HangulAutomaton::flushInternal() {
+    preedit_[0] = 0;
+    saveCommit();
+}
+
+bool HangulAutomaton::process(int ascii) {
+    preedit_[0] = 0;
+    commit_[0] = 0;
+    uint32_t ch = ascii >= 0 && ascii < static_cast<int>(layout_->keymap.size())
+                      ? layout_->keymap[ascii]
+                      : 0;
+
+    if (ch && !isJamo(ch)) {
+        saveCommit();
+        auto *end = commit_;
+        while (*end) {
+            ++end;
+        }
+        end[0] = ch;
+        end[1] = 0;
+        return true;
+    }
+
+    return layout_->jaso ? processJaso(ch) : processJamo(ch);
+}
+
+bool HangulAutomaton::processJamo(uint32_t ch) {
+    if (jongseong_) {
+        if (isChoseong(ch)) {
+            auto jong = isModernChoseong(ch) ? choseongToJongseong[ch - 0x1100]
+                                             : 0;
+            auto combined = combine(jongseong_, jong);
+            if (isJongseong(combined)) {
+                if (!push(combined) && !push(ch)) {
+                    return false;
+                }
+            } else {
+                saveCommit();
+                if (!push(ch)) {
+                    return false;
+                }
+            }
+        } else if (isJungseong(ch)) {
+            // The last jongseong moves to the next syllable.
+            auto last = pop();
+            auto previous = peek();
+            uint32_t choseong = 0;
+            if (isJongseong(previous)) {
+                choseong = isModernJongseong(last)
+                               ? jongseongToChoseong[last - 0x11a8]
+                               : 0;
+                jongseong_ = previous;
+            } else if (isModernJongseong(jongseong_)) {
+                std::tie(jongseong_, choseong) =
+                    jongseongSplit[jongseong_ - 0x11a8];
+            }
+            saveCommit();
+            push(choseong);
+            if (!push(ch)) {
+                return false;
+            }
+        } else {
+            flushInternal();
+            return false;
+        }
+    } else if (jungseong_) {
+        if (isChoseong(ch)) {
+            if (choseong_) {
+                auto jong = isModernChoseong(ch)
+                                ? choseongToJongseong[ch - 0x1100]
+                                : 0;
+                if (isJongseong(jong)) {
+                    if (!push(jong) && !push(ch)) {
+                        return false;
+                    }
+                } else {
+                    saveCommit();
+                    if (!push(ch)) {
+                        return false;
+                    }
+                }
+            } else if (!push(ch) && !push(ch)) {
+                return false;
+            }
+        } else if (isJungseong(ch)) {
+            auto combined = combine(jungseong_, ch);
+            if (isJungseong(combined)) {
+                if (!push(combined)) {
+                    return false;
+                }
+            } else {
+                saveCommit();
+                if (!push(ch)) {
+                    return false;
+                }
+            }
+        } else {
+            flushInternal();
+            return false;
+        }
+    } else if (choseong_) {
+        if (isChoseong(ch)) {
+            if (!push(combine(choseong_, ch))) {
+                saveCommit();
+                if (!push(ch)) {
+                    return false;
+                }
+            }
+        } else if (!push(ch) && !push(ch)) {
+            return false;
+        }
+    } else if (!push(ch)) {
+        return false;
+    }
+
+    savePreedit();
+    return true;
+}
+
+bool HangulAutomaton::processJaso(uint32_t ch) {
+    uint32_t current;
+    bool sameKind;
+    if (isChoseong(ch)) {
+        current = choseong_;
+        sameKind = isChoseong(peek());
+    } else if (isJungseong(ch)) {
+        current = jungseong_;
+        sameKind = isJungseong(peek());
+    } else if (isJongseong(ch)) {
+        current = jongseong_;
+        sameKind = isJongseong(peek());
+    } else {
+        flushInternal();
+        return false;
+    }
+
+    if (!current) {
+        if (!push(ch) && !push(ch)) {
+            return false;
+        }
+    } else if (auto combined = sameKind ? combine(current, ch) : 0) {
+        // Only combines with the jamo typed right before.
+        if (!push(combined) && !push(combined)) {
+            return false;
+        }
+    } else {
+        saveCommit();
+        if (!push(ch)) {
+            return false;
+        }
+    }
+
+    savePreedit();
+    return true;
+}
+
+bool HangulAutomaton::backspace() {
+    preedit_[0] = 0;
+    commit_[0] = 0;
+    auto ch = pop();
+    if (!ch) {
+        return false;
+    }
+    if (index_ < 0) {
+        clearBuffer();
+    } else {
+        // Go back to the jamo of the same kind pushed before, if any.
+        auto previous = peek();
+        if (isChoseong(ch)) {
+            choseong_ = isChoseong(previous) ? previous : 0;
+        } else if (isJungseong(ch)) {
+            jungseong_ = isJungseong(previous) ? previous : 0;
+        } else {
+            jongseong_ = isJongseong(previous) ? previous : 0;
+        }
+    }
+    savePreedit();
+    return true;
+}
+
+void HangulAutomaton::reset() {
+    preedit_[0] = 0;
+    commit_[0] = 0;
+    flushed_[0] = 0;
+    clearBuffer();
+}
+
+const uint32_t *HangulAutomaton::flush() {
+    preedit_[0] = 0;
+    commit_[0] = 0;
+    bufferString(flushed_);
+    clearBuffer();
+    return flushed_;
+}
+
+} // namespace fcitx
@@ -0,0 +1,87 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_HANGUL_HANGULAUTOMATON_H_
+#define _FCITX5_HANGUL_HANGULAUTOMATON_H_
+
+#include <cstdint>
+#include <string_view>
+
+namespace fcitx {
+
+// Composition of jamo based layouts, behaving the same as
+// HangulInputContext of libhangul with the same keyboard.
+//
+// libhangul looks up the keyboard and combination tables through several
+// indirections on every key, here the tables of the layout are built at
+// compile time and composition is a few array lookups. Strings use the same
+// representation as libhangul, zero terminated UCS-4.
+class HangulAutomaton {
+public:
+    struct Options {
+        // Same as HANGUL_IC_OPTION_AUTO_REORDER.
+        bool autoReorder = true;
+        // Same as HANGUL_IC_OPTION_COMBI_ON_DOUBLE_STROKE, libhangul before
+        // 0.2 always combines.
+        bool combiOnDoubleStroke = true;
+    };
+
+    struct Layout;
+
+    // Return nullptr if keyboard, the libhangul keyboard id, is not built in.
+    static const Layout *layout(std::string_view keyboard);
+
+    HangulAutomaton(const Layout *layout, Options options);
+
+    void setOptions(Options options) { options_ = options; }
+
+    // Same as hangul_ic_process, hangul_ic_backspace, hangul_ic_reset and
+    // hangul_ic_flush.
+    bool process(int ascii);
+    bool backspace();
+    void reset();
+    const uint32_t *flush();
+
+    bool isEmpty() const { return !choseong_ && !jungseong_ && !jongseong_; }
+    bool hasChoseong() const { return choseong_; }
+    bool hasJungseong() const { return jungseong_; }
+    bool hasJongseong() const { return jongseong_; }
+
+    const uint32_t *preeditString() const { return preedit_; }
+    const uint32_t *commitString() const { return commit_; }
+
+private:
+    bool push(uint32_t c);
+    uint32_t pop();
+    uint32_t peek() const;
+    uint32_t combine(uint32_t first, uint32_t second) const;
+    // Same as hangul_ic_process_jamo and hangul_ic_process_jaso, for a jamo
+    // or 0.
+    bool processJamo(uint32_t ch);
+    bool processJaso(uint32_t ch);
+    void clearBuffer();
+    // Write the current syllable to str, return the number of characters.
+    int bufferString(uint32_t *str) const;
+    void saveCommit();
+    void savePreedit();
+    void flushInternal();
+
+    const Layout *layout_;
+    Options options_;
+    uint32_t choseong_ = 0;
+    uint32_t jungseong_ = 0;
+    uint32_t jongseong_ = 0;
+    // Jamo in the order they are pushed, backspace pops them one by one.
+    uint32_t stack_[12] = {};
+    int index_ = -1;
+    uint32_t preedit_[4] = {};
+    uint32_t commit_[16] = {};
+    uint32_t flushed_[4] = {};
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_HANGUL_HANGULAUTOMATON_H_
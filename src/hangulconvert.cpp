@@ -0,0 +1,542 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "hangulautomaton.h"
+#include "hanjadict.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <hangul.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Convert text in bulk with the same code as the engine: keys typed with a
+// keyboard layout to hangul, and hangul words to hanja. Input is read in
+// chunks of whole lines that are converted by several threads, and written
+// in the original order. Memory use only depends on the chunk size and the
+// number of threads, not on the size of input.
+
+namespace {
+
+constexpr size_t ChunkSize = 1 << 20;
+
+enum class HanjaMode { None, Convert, Annotate };
+
+struct Options {
+    std::string keyboard;
+    bool automaton = false;
+    HanjaMode hanjaMode = HanjaMode::None;
+    size_t minLength = 2;
+    unsigned threads = 0;
+    bool stats = false;
+};
+
+void usage(const char *name) {
+    std::fprintf(
+        stderr,
+        "Usage: %s [options] [file...]\n"
+        "Convert files, or standard input, to standard output.\n"
+        "  -k <keyboard>  Type the text with libhangul keyboard, e.g. 2, 3f\n"
+        "  -a             Use the built-in automaton if keyboard has one\n"
+        "  -d <source>    Load a text dictionary, may be repeated\n"
+        "  -i <image>     Load a dictionary compiled by hangul-compile-dict\n"
+        "  -c             Convert hangul words to hanja, e.g. 한자 to 漢字\n"
+        "  -n             Annotate hangul words with hanja, e.g. 한자 to "
+        "한자(漢字)\n"
+        "  -l <length>    Shortest word to convert, default 2\n"
+        "  -j <threads>   Number of threads, default number of CPUs\n"
+        "  -s             Print throughput to standard error\n",
+        name);
+}
+
+void appendUCS4(std::string &out, const ucschar *str) {
+    for (; str && *str; ++str) {
+        auto c = *str;
+        if (c < 0x80) {
+            out.push_back(static_cast<char>(c));
+        } else if (c < 0x800) {
+            out.push_back(static_cast<char>(0xc0 | (c >> 6)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else if (c < 0x10000) {
+            out.push_back(static_cast<char>(0xe0 | (c >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else {
+            out.push_back(static_cast<char>(0xf0 | (c >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        }
+    }
+}
+
+size_t utf8Length(unsigned char c) {
+    if (c < 0x80) {
+        return 1;
+    }
+    if ((c & 0xe0) == 0xc0) {
+        return 2;
+    }
+    if ((c & 0xf0) == 0xe0) {
+        return 3;
+    }
+    if ((c & 0xf8) == 0xf0) {
+        return 4;
+    }
+    return 1;
+}
+
+// Hangul syllables are U+AC00 to U+D7A3, ea b0 80 to ed 9e a3 in utf8.
+bool isSyllable(std::string_view text, size_t pos) {
+    if (pos + 3 > text.size()) {
+        return false;
+    }
+    auto c0 = static_cast<unsigned char>(text[pos]);
+    auto c1 = static_cast<unsigned char>(text[pos + 1]);
+    if (c0 < 0xea || c0 > 0xed) {
+        return false;
+    }
+    uint32_t c = ((c0 & 0x0f) << 12) | ((c1 & 0x3f) << 6) |
+                 (static_cast<unsigned char>(text[pos + 2]) & 0x3f);
+    return c >= 0xac00 && c <= 0xd7a3;
+}
+
+// Same as the defaults of the engine, for both the automaton and libhangul,
+// so -a doesn't change the result.
+fcitx::HangulAutomaton::Options compositionOptions() {
+    fcitx::HangulAutomaton::Options options;
+    options.autoReorder = true;
+#if defined(FCITX_HANGUL_VERSION_0_2)
+    options.combiOnDoubleStroke = false;
+#endif
+    return options;
+}
+
+// Per thread state, libhangul contexts can't be shared.
+class Converter {
+public:
+    Converter(const Options &options, const fcitx::HanjaDictionary *dict)
+        : options_(options), dict_(dict) {
+        if (options.keyboard.empty()) {
+            return;
+        }
+        if (options.automaton) {
+            if (const auto *layout =
+                    fcitx::HangulAutomaton::layout(options.keyboard)) {
+                automaton_ = std::make_unique<fcitx::HangulAutomaton>(
+                    layout, compositionOptions());
+                return;
+            }
+        }
+        context_.reset(hangul_ic_new(options.keyboard.c_str()));
+#if defined(FCITX_HANGUL_VERSION_0_2)
+        auto composition = compositionOptions();
+        hangul_ic_set_option(context_.get(), HANGUL_IC_OPTION_AUTO_REORDER,
+                             composition.autoReorder);
+        hangul_ic_set_option(context_.get(),
+                             HANGUL_IC_OPTION_COMBI_ON_DOUBLE_STROKE,
+                             composition.combiOnDoubleStroke);
+        hangul_ic_set_option(context_.get(),
+                             HANGUL_IC_OPTION_NON_CHOSEONG_COMBI, true);
+#endif
+    }
+
+    void convert(std::string_view input, std::string &output) {
+        output.clear();
+        if (!hasKeyboard()) {
+            convertHanja(input, output);
+            return;
+        }
+        typed_.clear();
+        size_t start = 0;
+        while (start < input.size()) {
+            auto end = input.find('\n', start);
+            end = end == std::string_view::npos ? input.size() : end + 1;
+            type(input.substr(start, end - start), typed_);
+            start = end;
+        }
+        convertHanja(typed_, output);
+    }
+
+private:
+    bool hasKeyboard() const { return context_ || automaton_; }
+
+    bool process(int ascii) {
+        return automaton_ ? automaton_->process(ascii)
+                          : hangul_ic_process(context_.get(), ascii);
+    }
+    const ucschar *commitString() const {
+        return automaton_ ? automaton_->commitString()
+                          : hangul_ic_get_commit_string(context_.get());
+    }
+    const ucschar *flush() {
+        return automaton_ ? automaton_->flush()
+                          : hangul_ic_flush(context_.get());
+    }
+
+    // Same as typing the line in the engine, characters not used by the
+    // keyboard end the syllable and are copied as is.
+    void type(std::string_view line, std::string &output) {
+        for (char c : line) {
+            auto ascii = static_cast<unsigned char>(c);
+            if (ascii > 0x20 && ascii < 0x7f) {
+                bool used = process(ascii);
+                appendUCS4(output, commitString());
+                if (used) {
+                    continue;
+                }
+            }
+            appendUCS4(output, flush());
+            output.push_back(c);
+        }
+        appendUCS4(output, flush());
+    }
+
+    void convertHanja(std::string_view text, std::string &output) {
+        if (!dict_ || options_.hanjaMode == HanjaMode::None) {
+            output.append(text);
+            return;
+        }
+        size_t pos = 0;
+        while (pos < text.size()) {
+            if (!isSyllable(text, pos)) {
+                auto length = std::min(
+                    utf8Length(static_cast<unsigned char>(text[pos])),
+                    text.size() - pos);
+                output.append(text.substr(pos, length));
+                pos += length;
+                continue;
+            }
+            size_t end = pos;
+            while (isSyllable(text, end)) {
+                end += 3;
+            }
+            convertWord(text.substr(pos, end - pos), output);
+            pos = end;
+        }
+    }
+
+    // Replace the longest known word at each position, the first entry of a
+    // key is the most common one.
+    void convertWord(std::string_view word, std::string &output) {
+        size_t pos = 0;
+        while (pos < word.size()) {
+            auto matches = dict_->matchPrefix(word.substr(pos));
+            // Every syllable is 3 bytes.
+            if (!matches.empty() &&
+                matches.key(0).size() >= options_.minLength * 3) {
+                auto key = matches.key(0);
+                if (options_.hanjaMode == HanjaMode::Annotate) {
+                    output.append(key).append("(").append(matches.value(0))
+                        .append(")");
+                } else {
+                    output.append(matches.value(0));
+                }
+                pos += key.size();
+            } else {
+                output.append(word.substr(pos, 3));
+                pos += 3;
+            }
+        }
+    }
+
+    const Options &options_;
+    const fcitx::HanjaDictionary *dict_;
+    std::unique_ptr<HangulInputContext, decltype(&hangul_ic_delete)> context_{
+        nullptr, &hangul_ic_delete};
+    std::unique_ptr<fcitx::HangulAutomaton> automaton_;
+    std::string typed_;
+};
+
+// Chunks are read, converted and written in a ring, a slot is reused once
+// its chunk is written.
+struct Chunk {
+    enum class State { Free, Read, Converting, Converted };
+    State state = State::Free;
+    uint64_t sequence = 0;
+    std::string input;
+    std::string output;
+};
+
+class Pipeline {
+public:
+    Pipeline(const Options &options, const fcitx::HanjaDictionary *dict)
+        : options_(options), dict_(dict), chunks_(options.threads * 2) {}
+
+    // Return false if output can't be written.
+    bool run(const std::vector<std::FILE *> &inputs) {
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < options_.threads; i++) {
+            workers.emplace_back(&Pipeline::convert, this);
+        }
+        std::thread writer(&Pipeline::write, this);
+
+        // Files are not joined, the last line of a file ends with it even
+        // if it has no line end.
+        for (auto *file : inputs) {
+            std::string pending;
+            if (!read(file, pending) ||
+                (!pending.empty() && !submit(std::move(pending)))) {
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            eof_ = true;
+        }
+        cond_.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        writer.join();
+        return !failed_;
+    }
+
+    uint64_t bytesRead() const { return bytesRead_; }
+
+private:
+    // Split input at line ends, pending keeps the incomplete last line.
+    // Return false if output already failed.
+    bool read(std::FILE *file, std::string &pending) {
+        std::string buffer(ChunkSize, '\0');
+        size_t n;
+        while ((n = std::fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+            bytesRead_ += n;
+            pending.append(buffer.data(), n);
+            if (pending.size() < ChunkSize) {
+                continue;
+            }
+            auto end = pending.rfind('\n');
+            if (end == std::string::npos) {
+                continue;
+            }
+            std::string rest = pending.substr(end + 1);
+            pending.resize(end + 1);
+            if (!submit(std::move(pending))) {
+                return false;
+            }
+            pending = std::move(rest);
+        }
+        return true;
+    }
+
+    // Wait for a free slot, return false if output already failed.
+    bool submit(std::string input) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto &chunk = chunks_[nextRead_ % chunks_.size()];
+        cond_.wait(lock, [&chunk, this]() {
+            return chunk.state == Chunk::State::Free || failed_;
+        });
+        if (failed_) {
+            return false;
+        }
+        chunk.input = std::move(input);
+        chunk.sequence = nextRead_++;
+        chunk.state = Chunk::State::Read;
+        cond_.notify_all();
+        return true;
+    }
+
+    void convert() {
+        Converter converter(options_, dict_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            auto *chunk = &chunks_[nextConvert_ % chunks_.size()];
+            cond_.wait(lock, [&chunk, this]() {
+                chunk = &chunks_[nextConvert_ % chunks_.size()];
+                return (chunk->state == Chunk::State::Read &&
+                        chunk->sequence == nextConvert_) ||
+                       (eof_ && nextConvert_ == nextRead_);
+            });
+            if (chunk->state != Chunk::State::Read ||
+                chunk->sequence != nextConvert_) {
+                return;
+            }
+            nextConvert_++;
+            chunk->state = Chunk::State::Converting;
+            lock.unlock();
+            converter.convert(chunk->input, chunk->output);
+            lock.lock();
+            chunk->state = Chunk::State::Converted;
+            cond_.notify_all();
+        }
+    }
+
+    void write() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            auto &chunk = chunks_[nextWrite_ % chunks_.size()];
+            cond_.wait(lock, [&chunk, this]() {
+                return (chunk.state == Chunk::State::Converted &&
+                        chunk.sequence == nextWrite_) ||
+                       (eof_ && nextWrite_ == nextRead_);
+            });
+            if (chunk.state != Chunk::State::Converted) {
+                return;
+            }
+            lock.unlock();
+            bool written = std::fwrite(chunk.output.data(), 1,
+                                       chunk.output.size(),
+                                       stdout) == chunk.output.size();
+            lock.lock();
+            failed_ = failed_ || !written;
+            chunk.state = Chunk::State::Free;
+            nextWrite_++;
+            cond_.notify_all();
+        }
+    }
+
+    const Options &options_;
+    const fcitx::HanjaDictionary *dict_;
+    std::vector<Chunk> chunks_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    uint64_t nextRead_ = 0;
+    uint64_t nextConvert_ = 0;
+    uint64_t nextWrite_ = 0;
+    bool eof_ = false;
+    bool failed_ = false;
+    uint64_t bytesRead_ = 0;
+};
+
+bool hasKeyboard(const std::string &id) {
+    for (unsigned i = 0; i < hangul_ic_get_n_keyboards(); i++) {
+        if (id == hangul_ic_get_keyboard_id(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<std::string> readImage(const char *path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in) {
+        return std::nullopt;
+    }
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options options;
+    std::vector<std::string> sources;
+    const char *image = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "k:ad:i:cnl:j:sh")) != -1) {
+        switch (opt) {
+        case 'k':
+            options.keyboard = optarg;
+            break;
+        case 'a':
+            options.automaton = true;
+            break;
+        case 'd':
+            sources.emplace_back(optarg);
+            break;
+        case 'i':
+            image = optarg;
+            break;
+        case 'c':
+            options.hanjaMode = HanjaMode::Convert;
+            break;
+        case 'n':
+            options.hanjaMode = HanjaMode::Annotate;
+            break;
+        case 'l':
+            options.minLength = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'j':
+            options.threads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 's':
+            options.stats = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!options.keyboard.empty() && !hasKeyboard(options.keyboard)) {
+        std::fprintf(stderr, "Unknown keyboard %s\n", options.keyboard.c_str());
+        return 1;
+    }
+    if (options.threads == 0) {
+        options.threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    fcitx::HanjaDictionary dict;
+    if (options.hanjaMode != HanjaMode::None) {
+        std::optional<std::string> data;
+        if (image) {
+            data = readImage(image);
+        } else if (!sources.empty()) {
+            data = fcitx::HanjaDictionary::compile(sources);
+        } else {
+            std::fprintf(stderr, "Hanja conversion needs -d or -i\n");
+            return 1;
+        }
+        if (!data || !dict.load(std::move(*data))) {
+            std::fprintf(stderr, "Failed to load dictionary\n");
+            return 1;
+        }
+    }
+
+    std::vector<std::FILE *> inputs;
+    for (int i = optind; i < argc; i++) {
+        if (std::string_view(argv[i]) == "-") {
+            inputs.push_back(stdin);
+            continue;
+        }
+        auto *file = std::fopen(argv[i], "rb");
+        if (!file) {
+            std::fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        inputs.push_back(file);
+    }
+    if (inputs.empty()) {
+        inputs.push_back(stdin);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Pipeline pipeline(options,
+                      options.hanjaMode == HanjaMode::None ? nullptr : &dict);
+    bool success = pipeline.run(inputs);
+    success = std::fflush(stdout) == 0 && success;
+    for (auto *file : inputs) {
+        if (file != stdin) {
+            std::fclose(file);
+        }
+    }
+    if (options.stats) {
+        auto seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+        std::fprintf(stderr, "%llu bytes in %.3f s, %.1f MiB/s\n",
+                     static_cast<unsigned long long>(pipeline.bytesRead()),
+                     seconds, pipeline.bytesRead() / seconds / (1 << 20));
+    }
+    if (!success) {
+        std::fprintf(stderr, "Failed to write output\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,983 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+
+#include "hanjadict.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace fcitx {
+
+namespace {
+
+constexpr char dictMagic[8] = {'F', 'C', 'H', 'A', 'N', 'J', 'A', '\0'};
+constexpr uint32_t dictVersion = 4;
+constexpr uint32_t dictByteOrder = 0x01020304;
+constexpr uint32_t invalidIndex = UINT32_MAX;
+
+uint64_t hashBytes(std::string_view data) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool readFile(const std::string &path, std::string &content) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    content.assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+int64_t mtimeOf(const struct stat &st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL +
+           st.st_mtim.tv_nsec;
+}
+
+// Move to the start of next utf8 character.
+size_t nextChar(std::string_view str, size_t pos) {
+    if (pos >= str.size()) {
+        return str.size();
+    }
+    ++pos;
+    while (pos < str.size() &&
+           (static_cast<unsigned char>(str[pos]) & 0xC0) == 0x80) {
+        ++pos;
+    }
+    return pos;
+}
+
+// Move to the start of previous utf8 character.
+size_t prevChar(std::string_view str, size_t pos) {
+    if (pos == 0) {
+        return 0;
+    }
+    --pos;
+    while (pos > 0 && (static_cast<unsigned char>(str[pos]) & 0xC0) == 0x80) {
+        --pos;
+    }
+    return pos;
+}
+
+// Decode the utf8 character at pos, invalid byte is returned as is.
+uint32_t decodeChar(std::string_view str, size_t pos) {
+    auto c = static_cast<unsigned char>(str[pos]);
+    size_t len;
+    uint32_t result;
+    if ((c & 0xE0) == 0xC0) {
+        len = 2;
+        result = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        len = 3;
+        result = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        len = 4;
+        result = c & 0x07;
+    } else {
+        return c;
+    }
+    for (size_t i = 1; i < len && pos + i < str.size(); i++) {
+        result = (result << 6) | (static_cast<unsigned char>(str[pos + i]) &
+                                  0x3F);
+    }
+    return result;
+}
+
+// Same as strtok(line, ":"), which is what libhangul uses to split the line.
+std::string_view nextField(std::string_view line, size_t &pos) {
+    while (pos < line.size() && line[pos] == ':') {
+        ++pos;
+    }
+    auto start = pos;
+    while (pos < line.size() && line[pos] != ':') {
+        ++pos;
+    }
+    auto field = line.substr(start, pos - start);
+    if (pos < line.size()) {
+        ++pos;
+    }
+    return field;
+}
+
+class StringPool {
+public:
+    uint32_t intern(std::string_view str) {
+        auto iter = offsets_.find(str);
+        if (iter != offsets_.end()) {
+            return iter->second;
+        }
+        auto offset = static_cast<uint32_t>(pool_.size());
+        pool_.append(str.data(), str.size());
+        pool_.push_back('\0');
+        offsets_.emplace(str, offset);
+        return offset;
+    }
+
+    const std::string &data() const { return pool_; }
+
+private:
+    std::string pool_;
+    // Keys are views into the source text, which outlives the pool.
+    std::unordered_map<std::string_view, uint32_t> offsets_;
+};
+
+template <typename T>
+void appendRaw(std::string &out, const T &value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+void appendRaw(std::string &out, const std::vector<T> &values) {
+    out.append(reinterpret_cast<const char *>(values.data()),
+               values.size() * sizeof(T));
+}
+
+} // namespace
+
+struct HanjaDictionary::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t keyCount;
+    uint32_t entryCount;
+    uint32_t suffixNodeCount;
+    uint32_t suffixEdgeCount;
+    uint32_t poolSize;
+    // In characters.
+    uint32_t maxKeyLength;
+    uint32_t sourceCount;
+    uint32_t reserved;
+};
+
+// Recorded for each source file to check whether the image is up to date.
+struct HanjaDictionary::SourceRecord {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+};
+
+struct HanjaDictionary::KeyRecord {
+    uint32_t key;
+    uint32_t keyLength;
+    uint32_t firstEntry;
+    uint32_t entryCount;
+};
+
+struct HanjaDictionary::EntryRecord {
+    uint32_t value;
+    uint32_t valueLength;
+    uint32_t comment;
+    uint32_t commentLength;
+    uint32_t source;
+};
+
+// Trie of reversed keys, so all the keys that are suffix of a string can be
+// found by a single walk from the end of the string. Nodes are stored in
+// breadth first order, the edges of node n are [n.firstEdge,
+// (n + 1).firstEdge), sorted by character. The last node is a sentinel.
+struct HanjaDictionary::SuffixNode {
+    uint32_t firstEdge;
+    uint32_t keyIndex;
+};
+
+struct HanjaDictionary::SuffixEdge {
+    uint32_t character;
+    uint32_t node;
+};
+
+namespace {
+
+class SuffixTrieBuilder {
+public:
+    SuffixTrieBuilder() : nodes_(1) {}
+
+    void insert(std::string_view key, uint32_t keyIndex) {
+        uint32_t node = 0;
+        size_t pos = key.size();
+        while (pos > 0) {
+            pos = prevChar(key, pos);
+            auto c = decodeChar(key, pos);
+            auto &children = nodes_[node].children;
+            auto iter = std::find_if(
+                children.begin(), children.end(),
+                [c](const std::pair<uint32_t, uint32_t> &child) {
+                    return child.first == c;
+                });
+            if (iter != children.end()) {
+                node = iter->second;
+                continue;
+            }
+            auto child = static_cast<uint32_t>(nodes_.size());
+            children.emplace_back(c, child);
+            nodes_.emplace_back();
+            node = child;
+        }
+        nodes_[node].keyIndex = keyIndex;
+    }
+
+    template <typename Node, typename Edge>
+    void build(std::vector<Node> &nodes, std::vector<Edge> &edges) {
+        std::vector<uint32_t> order{0};
+        std::vector<uint32_t> index(nodes_.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            auto &children = nodes_[order[i]].children;
+            std::sort(children.begin(), children.end());
+            for (const auto &child : children) {
+                index[child.second] = order.size();
+                order.push_back(child.second);
+            }
+        }
+        for (auto node : order) {
+            nodes.push_back({static_cast<uint32_t>(edges.size()),
+                             nodes_[node].keyIndex});
+            for (const auto &child : nodes_[node].children) {
+                edges.push_back({child.first, index[child.second]});
+            }
+        }
+        nodes.push_back({static_cast<uint32_t>(edges.size()), invalidIndex});
+    }
+
+private:
+    struct Node {
+        uint32_t keyIndex = invalidIndex;
+        std::vector<std::pair<uint32_t, uint32_t>> children;
+    };
+    std::vector<Node> nodes_;
+};
+
+} // namespace
+
+void HanjaMatches::clear() {
+    dict_ = nullptr;
+    segments_.clear();
+    size_ = 0;
+    hidden_.clear();
+    promoted_.clear();
+    promotedSorted_.clear();
+}
+
+bool HanjaMatches::operator==(const HanjaMatches &other) const {
+    return dict_ == other.dict_ && size_ == other.size_ &&
+           std::equal(segments_.begin(), segments_.end(),
+                      other.segments_.begin(), other.segments_.end(),
+                      [](const Segment &lhs, const Segment &rhs) {
+                          return lhs.keyIndex == rhs.keyIndex &&
+                                 lhs.firstEntry == rhs.firstEntry &&
+                                 lhs.entryCount == rhs.entryCount &&
+                                 lhs.overlay == rhs.overlay &&
+                                 lhs.hiddenBegin == rhs.hiddenBegin &&
+                                 lhs.hiddenCount == rhs.hiddenCount;
+                      }) &&
+           hidden_ == other.hidden_ && promoted_ == other.promoted_;
+}
+
+void HanjaMatches::promote(const std::vector<uint32_t> &indexes) {
+    for (auto index : indexes) {
+        if (index < size_ && std::find(promoted_.begin(), promoted_.end(),
+                                       index) == promoted_.end()) {
+            promoted_.push_back(index);
+        }
+    }
+    promotedSorted_ = promoted_;
+    std::sort(promotedSorted_.begin(), promotedSorted_.end());
+}
+
+void HanjaMatches::append(const HanjaDictionary *dict, uint32_t keyIndex) {
+    const auto &record = dict->keys()[keyIndex];
+    if (!record.entryCount) {
+        return;
+    }
+    dict_ = dict;
+    segments_.push_back(
+        {keyIndex, record.firstEntry, record.entryCount, nullptr});
+    size_ += record.entryCount;
+}
+
+void HanjaMatches::overlay(const std::vector<const HanjaOverlayKey *> &keys) {
+    std::vector<Segment> segments;
+    segments.reserve(segments_.size() + keys.size());
+    auto iter = segments_.begin();
+    for (const auto *key : keys) {
+        if (key->entries.empty()) {
+            continue;
+        }
+        // Keys are all prefixes or all suffixes of the same string, so keys
+        // of the same length are the same.
+        while (iter != segments_.end() &&
+               segmentKey(*iter).size() > key->key.size()) {
+            segments.push_back(*iter++);
+        }
+        auto count = static_cast<uint32_t>(key->entries.size());
+        if (iter != segments_.end() &&
+            segmentKey(*iter).size() == key->key.size() && !iter->overlay) {
+            auto segment = *iter++;
+            segment.overlay = key;
+            segment.hiddenBegin = hidden_.size();
+            for (uint32_t i = 0; i < segment.entryCount; i++) {
+                const auto &entry = dict_->entries()[segment.firstEntry + i];
+                auto value = dict_->string(entry.value, entry.valueLength);
+                if (std::any_of(key->entries.begin(), key->entries.end(),
+                                [value](const HanjaOverlayKey::Entry &item) {
+                                    return item.value == value;
+                                })) {
+                    hidden_.push_back(i);
+                }
+            }
+            segment.hiddenCount = hidden_.size() - segment.hiddenBegin;
+            segment.entryCount += count - segment.hiddenCount;
+            size_ -= segment.hiddenCount;
+            segments.push_back(segment);
+        } else {
+            segments.push_back({invalidIndex, 0, count, key});
+        }
+        size_ += count;
+    }
+    segments.insert(segments.end(), iter, segments_.end());
+    segments_ = std::move(segments);
+}
+
+std::string_view HanjaMatches::segmentKey(const Segment &segment) const {
+    if (segment.overlay) {
+        return segment.overlay->key;
+    }
+    const auto &record = dict_->keys()[segment.keyIndex];
+    return dict_->string(record.key, record.keyLength);
+}
+
+const HanjaOverlayKey::Entry *
+HanjaMatches::overlayEntry(const Segment *segment, size_t &idx) {
+    if (!segment->overlay) {
+        return nullptr;
+    }
+    if (idx < segment->overlay->entries.size()) {
+        return &segment->overlay->entries[idx];
+    }
+    idx -= segment->overlay->entries.size();
+    return nullptr;
+}
+
+uint32_t HanjaMatches::tableEntry(const Segment *segment, size_t idx) const {
+    auto begin = hidden_.begin() + segment->hiddenBegin;
+    for (auto iter = begin, end = begin + segment->hiddenCount;
+         iter != end && *iter <= idx; ++iter) {
+        idx++;
+    }
+    return segment->firstEntry + idx;
+}
+
+const HanjaMatches::Segment *HanjaMatches::locate(size_t &idx) const {
+    if (idx < promoted_.size()) {
+        idx = promoted_[idx];
+    } else if (!promoted_.empty()) {
+        idx -= promoted_.size();
+        for (auto index : promotedSorted_) {
+            if (index > idx) {
+                break;
+            }
+            idx++;
+        }
+    }
+    for (const auto &segment : segments_) {
+        if (idx < segment.entryCount) {
+            return &segment;
+        }
+        idx -= segment.entryCount;
+    }
+    return nullptr;
+}
+
+std::string_view HanjaMatches::key(size_t idx) const {
+    const auto *segment = locate(idx);
+    if (!segment) {
+        return {};
+    }
+    return segmentKey(*segment);
+}
+
+size_t HanjaMatches::entryIndex(size_t idx) const {
+    return locate(idx) ? idx : 0;
+}
+
+std::string_view HanjaMatches::value(size_t idx) const {
+    const auto *segment = locate(idx);
+    if (!segment) {
+        return {};
+    }
+    if (const auto *entry = overlayEntry(segment, idx)) {
+        return entry->value;
+    }
+    const auto &entry = dict_->entries()[tableEntry(segment, idx)];
+    return dict_->string(entry.value, entry.valueLength);
+}
+
+uint32_t HanjaMatches::source(size_t idx) const {
+    const auto *segment = locate(idx);
+    if (!segment) {
+        return 0;
+    }
+    if (overlayEntry(segment, idx)) {
+        return OverlaySource;
+    }
+    return dict_->entries()[tableEntry(segment, idx)].source;
+}
+
+std::string_view HanjaMatches::comment(size_t idx) const {
+    const auto *segment = locate(idx);
+    if (!segment) {
+        return {};
+    }
+    if (const auto *entry = overlayEntry(segment, idx)) {
+        return entry->comment;
+    }
+    const auto &entry = dict_->entries()[tableEntry(segment, idx)];
+    return dict_->string(entry.comment, entry.commentLength);
+}
+
+HanjaDictionary::HanjaDictionary() = default;
+
+HanjaDictionary::~HanjaDictionary() { reset(); }
+
+void HanjaDictionary::reset() {
+    if (mapped_) {
+        munmap(mapped_, mappedSize_);
+    }
+    mapped_ = nullptr;
+    mappedSize_ = 0;
+    owned_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    pool_ = nullptr;
+}
+
+std::optional<std::string> HanjaDictionary::compile(const std::string &source) {
+    return compile(std::vector<std::string>{source});
+}
+
+std::optional<std::string>
+HanjaDictionary::compile(const std::vector<std::string> &sources) {
+    struct Item {
+        std::string_view key;
+        std::string_view value;
+        std::string_view comment;
+        uint32_t source;
+    };
+    std::vector<Item> items;
+    std::vector<std::string> contents(sources.size());
+    std::vector<SourceRecord> sourceRecords;
+
+    for (uint32_t i = 0; i < sources.size(); i++) {
+        struct stat st;
+        auto &content = contents[i];
+        if (stat(sources[i].c_str(), &st) != 0 ||
+            !readFile(sources[i], content)) {
+            return std::nullopt;
+        }
+        sourceRecords.push_back(
+            {content.size(), mtimeOf(st), hashBytes(content)});
+
+        std::string_view text(content);
+        size_t start = 0;
+        while (start < text.size()) {
+            auto end = text.find('\n', start);
+            if (end == std::string_view::npos) {
+                end = text.size();
+            }
+            auto line = text.substr(start, end - start);
+            start = end + 1;
+
+            std::string_view key;
+            std::string_view value;
+            std::string_view comment;
+            if (parseLine(line, key, value, comment)) {
+                items.push_back({key, value, comment, i});
+            }
+        }
+    }
+
+    // Entries with the same key are ordered by source, then keep the order in
+    // the file.
+    std::stable_sort(
+        items.begin(), items.end(),
+        [](const Item &lhs, const Item &rhs) { return lhs.key < rhs.key; });
+
+    uint32_t maxKeyLength = 0;
+    for (const auto &item : items) {
+        uint32_t length = 0;
+        for (size_t pos = 0; pos < item.key.size();
+             pos = nextChar(item.key, pos)) {
+            length++;
+        }
+        maxKeyLength = std::max(maxKeyLength, length);
+    }
+
+    StringPool pool;
+    std::vector<KeyRecord> keys;
+    std::vector<EntryRecord> entries;
+    entries.reserve(items.size());
+    for (const auto &item : items) {
+        if (keys.empty() ||
+            pool.data().compare(keys.back().key, keys.back().keyLength,
+                                item.key.data(), item.key.size()) != 0) {
+            keys.push_back({pool.intern(item.key),
+                            static_cast<uint32_t>(item.key.size()),
+                            static_cast<uint32_t>(entries.size()), 0});
+        }
+        keys.back().entryCount++;
+        entries.push_back({pool.intern(item.value),
+                           static_cast<uint32_t>(item.value.size()),
+                           pool.intern(item.comment),
+                           static_cast<uint32_t>(item.comment.size()),
+                           item.source});
+    }
+
+    SuffixTrieBuilder builder;
+    for (size_t i = 0; i < keys.size(); i++) {
+        builder.insert(std::string_view(pool.data())
+                           .substr(keys[i].key, keys[i].keyLength),
+                       i);
+    }
+    std::vector<SuffixNode> suffixNodes;
+    std::vector<SuffixEdge> suffixEdges;
+    builder.build(suffixNodes, suffixEdges);
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, dictMagic, sizeof(dictMagic));
+    header.version = dictVersion;
+    header.byteOrder = dictByteOrder;
+    header.keyCount = keys.size();
+    header.entryCount = entries.size();
+    header.suffixNodeCount = suffixNodes.size();
+    header.suffixEdgeCount = suffixEdges.size();
+    header.poolSize = pool.data().size();
+    header.maxKeyLength = maxKeyLength;
+    header.sourceCount = sourceRecords.size();
+
+    std::string image;
+    image.reserve(sizeof(Header) +
+                  sourceRecords.size() * sizeof(SourceRecord) +
+                  keys.size() * sizeof(KeyRecord) +
+                  entries.size() * sizeof(EntryRecord) +
+                  suffixNodes.size() * sizeof(SuffixNode) +
+                  suffixEdges.size() * sizeof(SuffixEdge) +
+                  pool.data().size());
+    appendRaw(image, header);
+    appendRaw(image, sourceRecords);
+    appendRaw(image, keys);
+    appendRaw(image, entries);
+    appendRaw(image, suffixNodes);
+    appendRaw(image, suffixEdges);
+    image.append(pool.data());
+    return image;
+}
+
+bool HanjaDictionary::parseLine(std::string_view line, std::string_view &key,
+                                std::string_view &value,
+                                std::string_view &comment) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    if (line.empty() || line[0] == '#') {
+        return false;
+    }
+    size_t pos = 0;
+    key = nextField(line, pos);
+    value = nextField(line, pos);
+    comment = line.substr(pos);
+    return !key.empty() && !value.empty();
+}
+
+bool HanjaDictionary::open(const std::string &image,
+                           const std::string &source) {
+    return open(image, std::vector<std::string>{source});
+}
+
+bool HanjaDictionary::open(const std::string &image,
+                           const std::vector<std::string> &sources) {
+    reset();
+    int fd = ::open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    mapped_ = mapped;
+    mappedSize_ = st.st_size;
+    if (!setData(static_cast<const char *>(mapped), st.st_size)) {
+        reset();
+        return false;
+    }
+
+    // Check the image is still up to date. Size and mtime are enough for the
+    // common case, but the content is checked if mtime changed (e.g. the file
+    // got reinstalled).
+    bool upToDate = sources.size() == header()->sourceCount;
+    std::vector<std::pair<size_t, int64_t>> touched;
+    for (size_t i = 0; upToDate && i < sources.size(); i++) {
+        const auto &record = sourceRecords()[i];
+        struct stat sourceSt;
+        upToDate = false;
+        if (stat(sources[i].c_str(), &sourceSt) == 0 &&
+            static_cast<uint64_t>(sourceSt.st_size) == record.size) {
+            if (mtimeOf(sourceSt) == record.mtime) {
+                upToDate = true;
+            } else {
+                std::string content;
+                upToDate = readFile(sources[i], content) &&
+                           hashBytes(content) == record.hash;
+                touched.emplace_back(i, mtimeOf(sourceSt));
+            }
+        }
+    }
+    if (!upToDate) {
+        reset();
+        return false;
+    }
+    if (!touched.empty()) {
+        updateMtime(image, touched);
+    }
+    return true;
+}
+
+// Record the new mtime of sources that are touched but not changed, so they
+// are only read once. Shared images are usually read only, and keep paying
+// for it.
+void HanjaDictionary::updateMtime(
+    const std::string &image,
+    const std::vector<std::pair<size_t, int64_t>> &touched) {
+    int fd = ::open(image.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    for (auto [index, mtime] : touched) {
+        auto offset = sizeof(Header) + index * sizeof(SourceRecord) +
+                      offsetof(SourceRecord, mtime);
+        if (pwrite(fd, &mtime, sizeof(mtime), offset) !=
+            static_cast<ssize_t>(sizeof(mtime))) {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+bool HanjaDictionary::load(std::string image) {
+    reset();
+    owned_ = std::move(image);
+    if (!setData(owned_.data(), owned_.size())) {
+        reset();
+        return false;
+    }
+    return true;
+}
+
+bool HanjaDictionary::setData(const char *data, size_t size) {
+    if (size < sizeof(Header)) {
+        return false;
+    }
+    const auto *header = reinterpret_cast<const Header *>(data);
+    if (memcmp(header->magic, dictMagic, sizeof(dictMagic)) != 0 ||
+        header->version != dictVersion ||
+        header->byteOrder != dictByteOrder) {
+        return false;
+    }
+    size_t expected =
+        sizeof(Header) +
+        static_cast<size_t>(header->sourceCount) * sizeof(SourceRecord) +
+        static_cast<size_t>(header->keyCount) * sizeof(KeyRecord) +
+        static_cast<size_t>(header->entryCount) * sizeof(EntryRecord) +
+        static_cast<size_t>(header->suffixNodeCount) * sizeof(SuffixNode) +
+        static_cast<size_t>(header->suffixEdgeCount) * sizeof(SuffixEdge) +
+        header->poolSize;
+    if (expected != size || header->suffixNodeCount < 2) {
+        return false;
+    }
+    data_ = data;
+    size_ = size;
+    pool_ = data + size - header->poolSize;
+    if (!validate()) {
+        data_ = nullptr;
+        size_ = 0;
+        pool_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// Records are used without checks by lookups, so a truncated or corrupted
+// image must not get past this.
+bool HanjaDictionary::validate() const {
+    const auto *header = this->header();
+    // Strings are followed by a nul in the pool.
+    auto validString = [header](uint32_t offset, uint32_t length) {
+        return static_cast<uint64_t>(offset) + length < header->poolSize;
+    };
+    for (uint32_t i = 0; i < header->keyCount; i++) {
+        const auto &key = keys()[i];
+        if (static_cast<uint64_t>(key.firstEntry) + key.entryCount >
+                header->entryCount ||
+            !validString(key.key, key.keyLength)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const auto &entry = entries()[i];
+        if (entry.source >= header->sourceCount ||
+            !validString(entry.value, entry.valueLength) ||
+            !validString(entry.comment, entry.commentLength)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const HanjaDictionary::Header *HanjaDictionary::header() const {
+    return reinterpret_cast<const Header *>(data_);
+}
+
+const HanjaDictionary::SourceRecord *HanjaDictionary::sourceRecords() const {
+    return reinterpret_cast<const SourceRecord *>(data_ + sizeof(Header));
+}
+
+const HanjaDictionary::KeyRecord *HanjaDictionary::keys() const {
+    return reinterpret_cast<const KeyRecord *>(
+        reinterpret_cast<const char *>(sourceRecords()) +
+        header()->sourceCount * sizeof(SourceRecord));
+}
+
+const HanjaDictionary::EntryRecord *HanjaDictionary::entries() const {
+    return reinterpret_cast<const EntryRecord *>(
+        reinterpret_cast<const char *>(keys()) +
+        header()->keyCount * sizeof(KeyRecord));
+}
+
+const HanjaDictionary::SuffixNode *HanjaDictionary::suffixNodes() const {
+    return reinterpret_cast<const SuffixNode *>(
+        reinterpret_cast<const char *>(entries()) +
+        header()->entryCount * sizeof(EntryRecord));
+}
+
+const HanjaDictionary::SuffixEdge *HanjaDictionary::suffixEdges() const {
+    return reinterpret_cast<const SuffixEdge *>(
+        reinterpret_cast<const char *>(suffixNodes()) +
+        header()->suffixNodeCount * sizeof(SuffixNode));
+}
+
+size_t HanjaDictionary::maxKeyLength() const {
+    return data_ ? header()->maxKeyLength : 0;
+}
+
+size_t HanjaDictionary::keyCount() const {
+    return data_ ? header()->keyCount : 0;
+}
+
+size_t HanjaDictionary::entryCount() const {
+    return data_ ? header()->entryCount : 0;
+}
+
+std::string_view HanjaDictionary::string(uint32_t offset,
+                                         uint32_t length) const {
+    if (static_cast<size_t>(offset) + length >= header()->poolSize) {
+        return {};
+    }
+    return {pool_ + offset, length};
+}
+
+int HanjaDictionary::findKey(std::string_view key) const {
+    if (!data_) {
+        return -1;
+    }
+    const auto *begin = keys();
+    const auto *end = begin + header()->keyCount;
+    const auto *iter = std::lower_bound(
+        begin, end, key, [this](const KeyRecord &record, std::string_view k) {
+            return string(record.key, record.keyLength) < k;
+        });
+    if (iter == end || string(iter->key, iter->keyLength) != key) {
+        return -1;
+    }
+    return iter - begin;
+}
+
+void HanjaDictionary::narrowPrefix(uint32_t &begin, uint32_t &end,
+                                   std::string_view prefix,
+                                   size_t known) const {
+    auto extra = prefix.substr(known);
+    auto tail = [this, known, &extra](const KeyRecord &record) {
+        auto key = string(record.key, record.keyLength);
+        return key.substr(std::min(known, key.size()), extra.size());
+    };
+    const auto *first = keys() + begin;
+    const auto *last = keys() + end;
+    first = std::lower_bound(first, last, extra,
+                             [&tail](const KeyRecord &record,
+                                     std::string_view value) {
+                                 return tail(record) < value;
+                             });
+    last = std::upper_bound(first, last, extra,
+                            [&tail](std::string_view value,
+                                    const KeyRecord &record) {
+                                return value < tail(record);
+                            });
+    begin = first - keys();
+    end = last - keys();
+}
+
+HanjaMatches HanjaDictionary::matchExact(std::string_view key) const {
+    HanjaMatches result;
+    if (auto idx = findKey(key); idx >= 0) {
+        result.append(this, idx);
+    }
+    return result;
+}
+
+HanjaMatches HanjaDictionary::matchPrefix(std::string_view key) const {
+    HanjaMatches result;
+    while (!key.empty()) {
+        if (auto idx = findKey(key); idx >= 0) {
+            result.append(this, idx);
+        }
+        key = key.substr(0, prevChar(key, key.size()));
+    }
+    return result;
+}
+
+uint32_t HanjaDictionary::findSuffixChild(uint32_t node,
+                                          uint32_t character) const {
+    const auto *nodes = suffixNodes();
+    // The last node is the sentinel.
+    if (node + 1 >= header()->suffixNodeCount) {
+        return invalidIndex;
+    }
+    auto edgeCount = header()->suffixEdgeCount;
+    const auto *begin =
+        suffixEdges() + std::min(nodes[node].firstEdge, edgeCount);
+    const auto *end =
+        suffixEdges() + std::min(nodes[node + 1].firstEdge, edgeCount);
+    const auto *iter = std::lower_bound(
+        begin, end, character, [](const SuffixEdge &edge, uint32_t c) {
+            return edge.character < c;
+        });
+    // Node comes from the image, reject it instead of reading past the
+    // nodes.
+    if (iter == end || iter->character != character ||
+        iter->node >= header()->suffixNodeCount - 1) {
+        return invalidIndex;
+    }
+    return iter->node;
+}
+
+HanjaMatches HanjaDictionary::matchSuffix(std::string_view key) const {
+    HanjaMatches result;
+    if (!data_) {
+        return result;
+    }
+    // Walk backward from the end of key, so the walk stops as soon as no
+    // longer key in dictionary ends with what has been seen so far.
+    std::vector<uint32_t> found;
+    uint32_t node = 0;
+    size_t pos = key.size();
+    while (pos > 0) {
+        pos = prevChar(key, pos);
+        node = findSuffixChild(node, decodeChar(key, pos));
+        if (node == invalidIndex) {
+            break;
+        }
+        auto keyIndex = suffixNodes()[node].keyIndex;
+        if (keyIndex < header()->keyCount) {
+            found.push_back(keyIndex);
+        }
+    }
+    // Longest suffix comes first.
+    for (auto iter = found.rbegin(), end = found.rend(); iter != end; ++iter) {
+        result.append(this, *iter);
+    }
+    return result;
+}
+
+void HanjaPrefixCursor::reset() {
+    dict_ = nullptr;
+    key_.clear();
+    levels_.clear();
+}
+
+HanjaMatches HanjaPrefixCursor::match(const HanjaDictionary *dict,
+                                      std::string_view key) {
+    HanjaMatches result;
+    if (dict != dict_) {
+        reset();
+        dict_ = dict;
+    }
+    if (!dict_ || !dict_->isValid()) {
+        return result;
+    }
+
+    size_t common = 0;
+    while (common < key.size() && common < key_.size() &&
+           key[common] == key_[common]) {
+        ++common;
+    }
+    while (!levels_.empty() && levels_.back().length > common) {
+        levels_.pop_back();
+    }
+
+    size_t pos = levels_.empty() ? 0 : levels_.back().length;
+    while (pos < key.size()) {
+        Level level;
+        if (levels_.empty()) {
+            level.begin = 0;
+            level.end = dict_->keyCount();
+        } else {
+            level.begin = levels_.back().begin;
+            level.end = levels_.back().end;
+        }
+        level.length = nextChar(key, pos);
+        level.exact = invalidIndex;
+        if (level.begin < level.end) {
+            dict_->narrowPrefix(level.begin, level.end,
+                                key.substr(0, level.length), pos);
+        }
+        // Shorter key sorts first.
+        if (level.begin < level.end &&
+            dict_->keys()[level.begin].keyLength == level.length) {
+            level.exact = level.begin;
+        }
+        levels_.push_back(level);
+        pos = level.length;
+    }
+    key_.assign(key.data(), key.size());
+
+    for (auto iter = levels_.rbegin(), end = levels_.rend(); iter != end;
+         ++iter) {
+        if (iter->exact != invalidIndex) {
+            result.append(dict_, iter->exact);
+        }
+    }
+    return result;
+}
+
+} // namespace fcitx
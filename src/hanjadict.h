@@ -0,0 +1,234 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_HANGUL_HANJADICT_H_
+#define _FCITX5_HANGUL_HANJADICT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+class HanjaDictionary;
+
+// Entries of a key kept in memory instead of a compiled image, e.g. the ones
+// of the user dictionary. See HanjaMatches::overlay().
+struct HanjaOverlayKey {
+    struct Entry {
+        std::string value;
+        std::string comment;
+
+        bool operator==(const Entry &other) const {
+            return value == other.value && comment == other.comment;
+        }
+    };
+
+    std::string key;
+    std::vector<Entry> entries;
+};
+
+// A list of matched dictionary entries. Entries are not copied, the list only
+// references the storage of the dictionary it comes from, so it must not
+// outlive it.
+class HanjaMatches {
+public:
+    HanjaMatches() = default;
+
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    void clear();
+
+    bool operator==(const HanjaMatches &other) const;
+    bool operator!=(const HanjaMatches &other) const {
+        return !(*this == other);
+    }
+
+    std::string_view key(size_t idx) const;
+    std::string_view value(size_t idx) const;
+    std::string_view comment(size_t idx) const;
+    // Index of the source file that the entry comes from, or OverlaySource.
+    uint32_t source(size_t idx) const;
+    // Index of the entry among the dictionary entries of its key.
+    size_t entryIndex(size_t idx) const;
+
+    // Number of matched keys. Entries of the same key are adjacent, in the
+    // order of keys.
+    size_t keyCount() const { return segments_.size(); }
+    size_t keyEntryCount(size_t keyIdx) const {
+        return segments_[keyIdx].entryCount;
+    }
+
+    // Move entries to the front in the given order, other entries keep their
+    // relative order. Indexes are the ones before any promotion, and
+    // duplicated or out of range indexes are ignored. Only meant for a few
+    // entries, since accessing other entries costs O(promoted) more.
+    void promote(const std::vector<uint32_t> &indexes);
+
+    static constexpr uint32_t OverlaySource = UINT32_MAX;
+
+    // Put the entries of keys before the entries of the same key, keys not in
+    // the list are inserted in place. Entries of the same key with a value
+    // in keys are dropped. keys must be matched the same way as this list, so
+    // both are ordered with the longest key first, and must outlive the list.
+    // Must be called before promote().
+    void overlay(const std::vector<const HanjaOverlayKey *> &keys);
+
+private:
+    friend class HanjaDictionary;
+    friend class HanjaPrefixCursor;
+
+    // Entries of overlay come first, and are counted by entryCount. keyIndex
+    // is invalid if the key is only in overlay. Dictionary entries dropped
+    // by overlay are hidden_[hiddenBegin, hiddenBegin + hiddenCount).
+    struct Segment {
+        uint32_t keyIndex;
+        uint32_t firstEntry;
+        uint32_t entryCount;
+        const HanjaOverlayKey *overlay;
+        uint32_t hiddenBegin = 0;
+        uint32_t hiddenCount = 0;
+    };
+
+    void append(const HanjaDictionary *dict, uint32_t keyIndex);
+    const Segment *locate(size_t &idx) const;
+    // Return the idx-th entry of segment if it is in overlay, otherwise
+    // make idx the index among the entries of dictionary.
+    static const HanjaOverlayKey::Entry *overlayEntry(const Segment *segment,
+                                                      size_t &idx);
+    // Dictionary entry of the idx-th entry of segment that is not hidden.
+    uint32_t tableEntry(const Segment *segment, size_t idx) const;
+    std::string_view segmentKey(const Segment &segment) const;
+
+    const HanjaDictionary *dict_ = nullptr;
+    std::vector<Segment> segments_;
+    size_t size_ = 0;
+    // Hidden entries of all segments, as sorted indexes among the dictionary
+    // entries of the key.
+    std::vector<uint32_t> hidden_;
+    // Promoted indexes in display order, and sorted.
+    std::vector<uint32_t> promoted_;
+    std::vector<uint32_t> promotedSorted_;
+};
+
+// Read-only hanja dictionary backed by a compiled binary image.
+//
+// The image is compiled from one or more libhangul format text files
+// (key:value:comment per line) and is usually memory mapped, so opening it is
+// cheap and the pages can be shared by all processes using the same file.
+// Every string in the image is nul terminated.
+//
+// When there are multiple source files, a single lookup covers all of them.
+// Entries of the same key are ordered by the order of their source files,
+// and each entry remembers its source.
+class HanjaDictionary {
+public:
+    HanjaDictionary();
+    ~HanjaDictionary();
+    HanjaDictionary(const HanjaDictionary &) = delete;
+    HanjaDictionary &operator=(const HanjaDictionary &) = delete;
+
+    // Compile the text dictionaries at |sources| into a binary image.
+    static std::optional<std::string>
+    compile(const std::vector<std::string> &sources);
+    static std::optional<std::string> compile(const std::string &source);
+
+    // Map the compiled image at |image|. Fails if the image is malformed or
+    // is not compiled from the current content of |sources|.
+    bool open(const std::string &image,
+              const std::vector<std::string> &sources);
+    bool open(const std::string &image, const std::string &source);
+    // Use an in memory image produced by compile().
+    bool load(std::string image);
+
+    // Split a line of text dictionary the same way as libhangul. Return false
+    // if the line is a comment or has no key or value.
+    static bool parseLine(std::string_view line, std::string_view &key,
+                          std::string_view &value, std::string_view &comment);
+
+    bool isValid() const { return data_ != nullptr; }
+    size_t keyCount() const;
+    size_t entryCount() const;
+    // Length of the longest key in characters.
+    size_t maxKeyLength() const;
+
+    HanjaMatches matchExact(std::string_view key) const;
+    // Match every prefix of key, the longest one comes first.
+    HanjaMatches matchPrefix(std::string_view key) const;
+    // Match every suffix of key, the longest one comes first.
+    HanjaMatches matchSuffix(std::string_view key) const;
+
+private:
+    friend class HanjaMatches;
+    friend class HanjaPrefixCursor;
+
+    struct Header;
+    struct SourceRecord;
+    struct KeyRecord;
+    struct EntryRecord;
+    struct SuffixNode;
+    struct SuffixEdge;
+
+    void reset();
+    bool setData(const char *data, size_t size);
+    bool validate() const;
+    static void
+    updateMtime(const std::string &image,
+                const std::vector<std::pair<size_t, int64_t>> &touched);
+    int findKey(std::string_view key) const;
+    // Narrow [begin, end), the keys starting with the first known bytes of
+    // prefix, to the keys starting with the whole prefix.
+    void narrowPrefix(uint32_t &begin, uint32_t &end, std::string_view prefix,
+                      size_t known) const;
+    uint32_t findSuffixChild(uint32_t node, uint32_t character) const;
+    std::string_view string(uint32_t offset, uint32_t length) const;
+
+    const Header *header() const;
+    const SourceRecord *sourceRecords() const;
+    const KeyRecord *keys() const;
+    const EntryRecord *entries() const;
+    const SuffixNode *suffixNodes() const;
+    const SuffixEdge *suffixEdges() const;
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    const char *pool_ = nullptr;
+    void *mapped_ = nullptr;
+    size_t mappedSize_ = 0;
+    std::string owned_;
+};
+
+// Cached state of prefix matching for a key that is typed one character at a
+// time. When the new key extends the last one, only the range of keys matched
+// by the last key is searched, and removing characters from the end pops back
+// to the result of the shorter key.
+class HanjaPrefixCursor {
+public:
+    void reset();
+    // Same as dict->matchPrefix(key).
+    HanjaMatches match(const HanjaDictionary *dict, std::string_view key);
+
+private:
+    struct Level {
+        size_t length;
+        uint32_t begin;
+        uint32_t end;
+        uint32_t exact;
+    };
+
+    const HanjaDictionary *dict_ = nullptr;
+    std::string key_;
+    // Level i is the range of keys starting with first i + 1 characters.
+    std::vector<Level> levels_;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_HANGUL_HANJADICT_H_
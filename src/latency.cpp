@@ -0,0 +1,77 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "latency.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace fcitx {
+
+FCITX_DEFINE_LOG_CATEGORY(hangul_latency, "hangul_latency");
+
+namespace {
+
+const char *const stageNames[] = {"KeyEvent",      "Process",  "Lookup",
+                                  "CandidateList", "UpdateUI", "Select"};
+static_assert(std::size(stageNames) ==
+              static_cast<size_t>(LatencyStage::Last));
+
+} // namespace
+
+void LatencyHistogram::add(uint64_t nsec) {
+    auto bucket = std::min<size_t>(std::bit_width(nsec | 1) - 1,
+                                   BucketCount - 1);
+    buckets_[bucket]++;
+    count_++;
+    total_ += nsec;
+    max_ = std::max(max_, nsec);
+}
+
+uint64_t LatencyHistogram::percentile(unsigned int percent) const {
+    if (!count_) {
+        return 0;
+    }
+    // Rank of the sample, starting from 1.
+    uint64_t rank = std::max<uint64_t>(1, (count_ * percent + 99) / 100);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BucketCount; i++) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+            return std::min(max_, (uint64_t(2) << i) - 1);
+        }
+    }
+    return max_;
+}
+
+void LatencyStats::reset() {
+    for (auto &histogram : histograms_) {
+        histogram.reset();
+    }
+}
+
+std::string LatencyStats::report() const {
+    std::string result;
+    char line[160];
+    for (size_t i = 0; i < histograms_.size(); i++) {
+        const auto &histogram = histograms_[i];
+        std::snprintf(
+            line, sizeof(line),
+            "%s: count=%llu mean=%lluns p50<=%lluns p90<=%lluns p99<=%lluns "
+            "max=%lluns\n",
+            stageNames[i], static_cast<unsigned long long>(histogram.count()),
+            static_cast<unsigned long long>(
+                histogram.count() ? histogram.total() / histogram.count() : 0),
+            static_cast<unsigned long long>(histogram.percentile(50)),
+            static_cast<unsigned long long>(histogram.percentile(90)),
+            static_cast<unsigned long long>(histogram.percentile(99)),
+            static_cast<unsigned long long>(histogram.max()));
+        result.append(line);
+    }
+    return result;
+}
+
+} // namespace fcitx
@@ -0,0 +1,108 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_HANGUL_LATENCY_H_
+#define _FCITX5_HANGUL_LATENCY_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-utils/log.h>
+#include <string>
+
+namespace fcitx {
+
+// Latency is only measured when this category is at debug level, e.g.
+// FCITX_LOG=hangul_latency=5.
+FCITX_DECLARE_LOG_CATEGORY(hangul_latency);
+
+enum class LatencyStage : uint8_t {
+    // The whole key event, including all the stages below.
+    KeyEvent,
+    // hangul_ic_process or hangul_ic_backspace.
+    Process,
+    // Hanja and symbol table lookup.
+    Lookup,
+    // Creating the candidate list.
+    CandidateList,
+    // Sending preedit and candidates to the frontend.
+    UpdateUI,
+    // Selecting a candidate.
+    Select,
+    Last,
+};
+
+// Histogram with power of two buckets, so recording a sample is only a few
+// instructions and the memory used is fixed.
+class LatencyHistogram {
+public:
+    // Bucket i holds samples in [2^i, 2^(i+1)) nanoseconds.
+    static constexpr size_t BucketCount = 40;
+
+    void add(uint64_t nsec);
+    void reset() { *this = LatencyHistogram(); }
+
+    uint64_t count() const { return count_; }
+    uint64_t total() const { return total_; }
+    uint64_t max() const { return max_; }
+    // Upper bound of the bucket containing the given percentile.
+    uint64_t percentile(unsigned int percent) const;
+
+private:
+    std::array<uint64_t, BucketCount> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+};
+
+class LatencyStats {
+public:
+    static bool enabled() {
+        return hangul_latency().checkLogLevel(LogLevel::Debug);
+    }
+
+    void add(LatencyStage stage, uint64_t nsec) {
+        histograms_[static_cast<size_t>(stage)].add(nsec);
+    }
+    void reset();
+    // One line per stage with count, mean, p50, p90, p99 and max.
+    std::string report() const;
+
+private:
+    std::array<LatencyHistogram, static_cast<size_t>(LatencyStage::Last)>
+        histograms_;
+};
+
+// Record the life time of this object to stats if latency is enabled.
+class LatencyTimer {
+public:
+    LatencyTimer(LatencyStats &stats, LatencyStage stage)
+        : stats_(LatencyStats::enabled() ? &stats : nullptr), stage_(stage) {
+        if (stats_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~LatencyTimer() {
+        if (stats_) {
+            stats_->add(stage_,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start_)
+                            .count());
+        }
+    }
+    LatencyTimer(const LatencyTimer &) = delete;
+    LatencyTimer &operator=(const LatencyTimer &) = delete;
+
+private:
+    LatencyStats *stats_;
+    LatencyStage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_HANGUL_LATENCY_H_
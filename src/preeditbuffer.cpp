@@ -0,0 +1,178 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+
+#include "preeditbuffer.h"
+#include <algorithm>
+#include <utility>
+
+namespace fcitx {
+
+namespace {
+
+void appendUTF8(std::string &str, uint32_t c) {
+    if (c < 0x80) {
+        str.push_back(static_cast<char>(c));
+        return;
+    }
+    char buf[4];
+    size_t length;
+    if (c < 0x800) {
+        length = 2;
+        buf[0] = static_cast<char>(0xC0 | (c >> 6));
+    } else if (c < 0x10000) {
+        length = 3;
+        buf[0] = static_cast<char>(0xE0 | (c >> 12));
+    } else {
+        length = 4;
+        buf[0] = static_cast<char>(0xF0 | ((c >> 18) & 0x07));
+    }
+    for (size_t i = length - 1; i > 0; i--, c >>= 6) {
+        buf[i] = static_cast<char>(0x80 | (c & 0x3F));
+    }
+    str.append(buf, length);
+}
+
+bool isContinuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+// Bytes of the last character of str.
+size_t lastCharLength(std::string_view str) {
+    auto pos = str.size();
+    while (pos > 0 && isContinuation(str[--pos])) {
+    }
+    return str.size() - pos;
+}
+
+// Bytes of the first n characters of str.
+size_t frontLength(std::string_view str, size_t n) {
+    size_t pos = 0;
+    for (; n > 0 && pos < str.size(); n--) {
+        do {
+            ++pos;
+        } while (pos < str.size() && isContinuation(str[pos]));
+    }
+    return pos;
+}
+
+} // namespace
+
+void PreeditBuffer::insert(const uint32_t *str) {
+    if (!str) {
+        return;
+    }
+    for (; *str; ++str) {
+        if (gapBegin_ == gapEnd_) {
+            grow(1);
+        }
+        buffer_[gapBegin_++] = *str;
+        appendUTF8(before_, *str);
+    }
+}
+
+bool PreeditBuffer::backspace() {
+    if (gapBegin_ == begin_) {
+        return false;
+    }
+    --gapBegin_;
+    before_.resize(before_.size() - lastCharLength(textBefore()));
+    return true;
+}
+
+bool PreeditBuffer::moveLeft() {
+    if (gapBegin_ == begin_) {
+        return false;
+    }
+    buffer_[--gapEnd_] = buffer_[--gapBegin_];
+    auto before = textBefore();
+    auto length = lastCharLength(before);
+    prependAfter(before.substr(before.size() - length));
+    before_.resize(before_.size() - length);
+    return true;
+}
+
+bool PreeditBuffer::moveRight() {
+    if (gapEnd_ == buffer_.size()) {
+        return false;
+    }
+    buffer_[gapBegin_++] = buffer_[gapEnd_++];
+    auto length = frontLength(textAfter(), 1);
+    before_.append(after_, afterBegin_, length);
+    afterBegin_ += length;
+    return true;
+}
+
+void PreeditBuffer::eraseFront(size_t n) {
+    n = std::min(n, size());
+    auto before = cursor();
+    if (n <= before) {
+        begin_ += n;
+        beforeBegin_ += frontLength(textBefore(), n);
+        // Take the space back once it's more than the text, so it costs
+        // O(1) amortized.
+        if (beforeBegin_ > before_.size() - beforeBegin_) {
+            before_.erase(0, beforeBegin_);
+            beforeBegin_ = 0;
+        }
+        return;
+    }
+    // Cursor ends up at the front.
+    begin_ = gapBegin_;
+    gapEnd_ += n - before;
+    before_.clear();
+    beforeBegin_ = 0;
+    afterBegin_ += frontLength(textAfter(), n - before);
+}
+
+void PreeditBuffer::clear() {
+    begin_ = gapBegin_ = 0;
+    gapEnd_ = buffer_.size();
+    before_.clear();
+    beforeBegin_ = 0;
+    afterBegin_ = after_.size();
+}
+
+void PreeditBuffer::release() {
+    std::vector<uint32_t>().swap(buffer_);
+    begin_ = gapBegin_ = gapEnd_ = 0;
+    std::string().swap(before_);
+    std::string().swap(after_);
+    beforeBegin_ = afterBegin_ = 0;
+}
+
+// Free space at the front is at least the size of text, so it costs O(1)
+// amortized like appending.
+void PreeditBuffer::prependAfter(std::string_view str) {
+    if (afterBegin_ < str.size()) {
+        auto text = textAfter();
+        auto space = std::max<size_t>({text.size(), str.size(), 16});
+        std::string after(space, '\0');
+        after.append(text);
+        after_ = std::move(after);
+        afterBegin_ = space;
+    }
+    afterBegin_ -= str.size();
+    std::copy(str.begin(), str.end(), after_.begin() + afterBegin_);
+}
+
+// At least double the size of text, so insertions cost O(1) amortized.
+void PreeditBuffer::grow(size_t n) {
+    auto before = cursor();
+    auto after = buffer_.size() - gapEnd_;
+    auto capacity = std::max<size_t>((before + after + n) * 2, 16);
+    std::vector<uint32_t> buffer(capacity);
+    std::copy(buffer_.begin() + begin_, buffer_.begin() + gapBegin_,
+              buffer.begin());
+    std::copy(buffer_.begin() + gapEnd_, buffer_.end(),
+              buffer.end() - after);
+    buffer_ = std::move(buffer);
+    begin_ = 0;
+    gapBegin_ = before;
+    gapEnd_ = capacity - after;
+}
+
+} // namespace fcitx
@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_HANGUL_PREEDITBUFFER_H_
+#define _FCITX5_HANGUL_PREEDITBUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fcitx {
+
+// Text of preedit with a cursor, in UCS-4.
+//
+// Characters are kept in a gap buffer: the gap sits at the cursor, so typing
+// and erasing at the cursor and moving it by one character never copy the
+// rest of the text. Text removed from the front is only skipped, and the
+// space is taken back the next time the buffer grows.
+//
+// The text before and after the cursor is also kept in UTF-8 and updated
+// with every edit, so it is not converted again to be shown.
+class PreeditBuffer {
+public:
+    bool empty() const { return size() == 0; }
+    size_t size() const {
+        return (gapBegin_ - begin_) + (buffer_.size() - gapEnd_);
+    }
+    // Number of characters before the cursor.
+    size_t cursor() const { return gapBegin_ - begin_; }
+
+    uint32_t operator[](size_t idx) const {
+        auto before = cursor();
+        return idx < before ? buffer_[begin_ + idx]
+                            : buffer_[gapEnd_ + idx - before];
+    }
+
+    // Text before and after the cursor in UTF-8, valid until the next edit.
+    std::string_view textBefore() const {
+        return std::string_view(before_).substr(beforeBegin_);
+    }
+    std::string_view textAfter() const {
+        return std::string_view(after_).substr(afterBegin_);
+    }
+
+    // Insert nul terminated str before the cursor.
+    void insert(const uint32_t *str);
+    // Remove the character before the cursor, return false if there is none.
+    bool backspace();
+    // Return false if the cursor can't move.
+    bool moveLeft();
+    bool moveRight();
+    // Remove n characters from the front.
+    void eraseFront(size_t n);
+    // Remove everything, and keep the memory for the next text.
+    void clear();
+    // Remove everything, and free the memory.
+    void release();
+
+private:
+    void grow(size_t n);
+    void prependAfter(std::string_view str);
+
+    std::vector<uint32_t> buffer_;
+    // Text is [begin_, gapBegin_) and [gapEnd_, buffer_.size()).
+    size_t begin_ = 0;
+    size_t gapBegin_ = 0;
+    size_t gapEnd_ = 0;
+    // UTF-8 text is [beforeBegin_, before_.size()) and
+    // [afterBegin_, after_.size()). The front of both is free space, so
+    // removing text from the front and moving the cursor left don't copy the
+    // rest of the text either.
+    std::string before_;
+    std::string after_;
+    size_t beforeBegin_ = 0;
+    size_t afterBegin_ = 0;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_HANGUL_PREEDITBUFFER_H_
@@ -0,0 +1,152 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+
+#include "userdict.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+namespace fcitx {
+
+namespace {
+
+bool isContinuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+size_t charLength(std::string_view str) {
+    return std::count_if(str.begin(), str.end(),
+                         [](char c) { return !isContinuation(c); });
+}
+
+} // namespace
+
+UserDictionary::Content UserDictionary::read(const std::string &path) {
+    Content content;
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in) {
+        return content;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string_view key;
+        std::string_view value;
+        std::string_view comment;
+        if (!HanjaDictionary::parseLine(line, key, value, comment)) {
+            continue;
+        }
+        auto iter = content.find(key);
+        if (iter == content.end()) {
+            iter = content.emplace(std::string(key), Entries()).first;
+        }
+        iter->second.push_back({std::string(value), std::string(comment)});
+    }
+    return content;
+}
+
+std::vector<UserDictionary::Change>
+UserDictionary::diff(const Content &content) const {
+    std::vector<Change> changes;
+    auto iter = keys_.begin();
+    for (const auto &[key, entries] : content) {
+        for (; iter != keys_.end() && iter->first < key; ++iter) {
+            changes.push_back({std::string(iter->first), {}});
+        }
+        if (iter != keys_.end() && iter->first == key) {
+            if (iter->second->entries != entries) {
+                changes.push_back({key, entries});
+            }
+            ++iter;
+        } else {
+            changes.push_back({key, entries});
+        }
+    }
+    for (; iter != keys_.end(); ++iter) {
+        changes.push_back({std::string(iter->first), {}});
+    }
+    return changes;
+}
+
+void UserDictionary::apply(std::vector<Change> changes) {
+    for (auto &change : changes) {
+        auto length = charLength(change.key);
+        if (auto iter = keys_.find(change.key); iter != keys_.end()) {
+            keys_.erase(iter);
+            if (--lengths_[length] == 0) {
+                lengths_.erase(length);
+            }
+        }
+        if (change.entries.empty()) {
+            continue;
+        }
+        auto key = std::make_unique<HanjaOverlayKey>();
+        key->key = std::move(change.key);
+        key->entries = std::move(change.entries);
+        std::string_view view = key->key;
+        keys_.emplace(view, std::move(key));
+        lengths_[length]++;
+    }
+}
+
+size_t UserDictionary::maxKeyLength() const {
+    return lengths_.empty() ? 0 : lengths_.rbegin()->first;
+}
+
+const HanjaOverlayKey *UserDictionary::find(std::string_view key) const {
+    auto iter = keys_.find(key);
+    return iter == keys_.end() ? nullptr : iter->second.get();
+}
+
+void UserDictionary::matchExact(std::string_view key,
+                                HanjaMatches &list) const {
+    if (const auto *found = find(key)) {
+        list.overlay({found});
+    }
+}
+
+void UserDictionary::matchPrefix(std::string_view key,
+                                 HanjaMatches &list) const {
+    std::vector<const HanjaOverlayKey *> found;
+    // Only prefixes up to the longest key may match.
+    auto maxLength = maxKeyLength();
+    size_t pos = 0;
+    for (size_t length = 0; pos < key.size() && length < maxLength;
+         length++) {
+        do {
+            ++pos;
+        } while (pos < key.size() && isContinuation(key[pos]));
+        if (const auto *item = find(key.substr(0, pos))) {
+            found.push_back(item);
+        }
+    }
+    if (!found.empty()) {
+        std::reverse(found.begin(), found.end());
+        list.overlay(found);
+    }
+}
+
+void UserDictionary::matchSuffix(std::string_view key,
+                                 HanjaMatches &list) const {
+    std::vector<const HanjaOverlayKey *> found;
+    auto maxLength = maxKeyLength();
+    size_t pos = key.size();
+    for (size_t length = 0; pos > 0 && length < maxLength; length++) {
+        do {
+            --pos;
+        } while (pos > 0 && isContinuation(key[pos]));
+        if (const auto *item = find(key.substr(pos))) {
+            found.push_back(item);
+        }
+    }
+    if (!found.empty()) {
+        std::reverse(found.begin(), found.end());
+        list.overlay(found);
+    }
+}
+
+} // namespace fcitx
@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_HANGUL_USERDICT_H_
+#define _FCITX5_HANGUL_USERDICT_H_
+
+#include "hanjadict.h"
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fcitx {
+
+// Dictionary of user, layered on top of the compiled tables.
+//
+// The file has the same format as the other text dictionaries. Unlike
+// HanjaDictionary it is kept in memory and updated in place: a new version of
+// the file is compared with the current content, and only the keys that are
+// changed are replaced.
+class UserDictionary {
+public:
+    using Entries = std::vector<HanjaOverlayKey::Entry>;
+    // Entries of each key, in the order of the file.
+    using Content = std::map<std::string, Entries, std::less<>>;
+
+    struct Change {
+        std::string key;
+        // Empty if the key is removed.
+        Entries entries;
+    };
+
+    // Read the text dictionary at path, a missing file is empty.
+    static Content read(const std::string &path);
+
+    // Changes that turn this dictionary into content. Only reads the
+    // dictionary, so it may run in another thread while nothing modifies it.
+    std::vector<Change> diff(const Content &content) const;
+    // Pointers to the keys that are changed become invalid.
+    void apply(std::vector<Change> changes);
+
+    size_t keyCount() const { return keys_.size(); }
+    // Length of the longest key in characters.
+    size_t maxKeyLength() const;
+
+    // Same as the ones of HanjaDictionary, but put the matched entries on
+    // top of list, which is matched from the tables with the same key.
+    void matchExact(std::string_view key, HanjaMatches &list) const;
+    void matchPrefix(std::string_view key, HanjaMatches &list) const;
+    void matchSuffix(std::string_view key, HanjaMatches &list) const;
+
+private:
+    const HanjaOverlayKey *find(std::string_view key) const;
+
+    // Keys view the key of their value.
+    std::map<std::string_view, std::unique_ptr<HanjaOverlayKey>> keys_;
+    // Number of keys of each length in characters.
+    std::map<size_t, size_t> lengths_;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_HANGUL_USERDICT_H_
@@ -0,0 +1,327 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+
+#include "userhistory.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace fcitx {
+
+namespace {
+
+constexpr char historyMagic[8] = {'F', 'C', 'H', 'H', 'I', 'S', 'T', '\0'};
+constexpr uint32_t historyVersion = 1;
+constexpr uint32_t historyByteOrder = 0x01020304;
+
+uint64_t hashBytes(std::string_view data) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// 0 marks an empty bucket in the table.
+uint64_t keyHashOf(std::string_view key) {
+    auto hash = hashBytes(key);
+    return hash ? hash : 1;
+}
+
+bool writeAll(int fd, const char *data, size_t size) {
+    while (size) {
+        auto written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+struct UserHistory::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t capacity;
+    uint64_t count;
+};
+
+UserHistory::UserHistory() = default;
+
+UserHistory::~UserHistory() { close(); }
+
+uint32_t UserHistory::valueHash(std::string_view value) {
+    auto hash = hashBytes(value);
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+void UserHistory::close() {
+    if (mapped_) {
+        munmap(mapped_, mappedSize_);
+    }
+    mapped_ = nullptr;
+    mappedSize_ = 0;
+    table_ = nullptr;
+    capacity_ = 0;
+}
+
+void UserHistory::open(std::string table, std::string log) {
+    close();
+    overlay_.clear();
+    logEntries_ = 0;
+    tablePath_ = std::move(table);
+    logPath_ = std::move(log);
+    map();
+    replayLog();
+}
+
+bool UserHistory::map() {
+    close();
+    int fd = ::open(tablePath_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+        mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    mapped_ = mapped;
+    mappedSize_ = st.st_size;
+
+    const auto *header = static_cast<const Header *>(mapped);
+    // Capacity must be a power of two for probing.
+    if (memcmp(header->magic, historyMagic, sizeof(historyMagic)) != 0 ||
+        header->version != historyVersion ||
+        header->byteOrder != historyByteOrder || header->capacity == 0 ||
+        (header->capacity & (header->capacity - 1)) != 0 ||
+        header->capacity > (mappedSize_ - sizeof(Header)) / sizeof(Bucket)) {
+        close();
+        return false;
+    }
+    const auto *table = reinterpret_cast<const Bucket *>(
+        static_cast<const char *>(mapped) + sizeof(Header));
+    // Buckets are copied and updated in place, so a count that doesn't fit
+    // would write past the entries.
+    for (uint64_t i = 0; i < header->capacity; i++) {
+        if (table[i].count > MaxPreferred) {
+            close();
+            return false;
+        }
+    }
+    capacity_ = header->capacity;
+    table_ = table;
+    return true;
+}
+
+void UserHistory::replayLog() {
+    std::ifstream in(logPath_);
+    std::string line;
+    // Each line is key, value hash and index separated by tab.
+    while (std::getline(in, line)) {
+        auto first = line.find('\t');
+        auto second = line.find('\t', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+        uint32_t hash = 0;
+        uint32_t index = 0;
+        const auto *hashEnd = line.data() + second;
+        const auto *end = line.data() + line.size();
+        if (std::from_chars(line.data() + first + 1, hashEnd, hash).ptr !=
+                hashEnd ||
+            std::from_chars(hashEnd + 1, end, index).ptr != end) {
+            continue;
+        }
+        update(keyHashOf(std::string_view(line).substr(0, first)), hash,
+               index);
+        logEntries_++;
+    }
+}
+
+void UserHistory::add(std::string_view key, std::string_view value,
+                      uint32_t index) {
+    if (key.empty() || logPath_.empty()) {
+        return;
+    }
+    auto hash = valueHash(value);
+    update(keyHashOf(key), hash, index);
+
+    std::string line(key);
+    line.append("\t")
+        .append(std::to_string(hash))
+        .append("\t")
+        .append(std::to_string(index))
+        .append("\n");
+    std::error_code ec;
+    std::filesystem::create_directories(
+        std::filesystem::path(logPath_).parent_path(), ec);
+    int fd = ::open(logPath_.c_str(),
+                    O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return;
+    }
+    if (writeAll(fd, line.data(), line.size())) {
+        logEntries_++;
+    }
+    ::close(fd);
+}
+
+void UserHistory::update(uint64_t keyHash, uint32_t valueHash,
+                         uint32_t index) {
+    auto iter = overlay_.find(keyHash);
+    if (iter == overlay_.end()) {
+        Bucket bucket{};
+        if (const auto *old = findInTable(keyHash)) {
+            bucket = *old;
+        }
+        bucket.keyHash = keyHash;
+        iter = overlay_.emplace(keyHash, bucket).first;
+    }
+    auto &bucket = iter->second;
+    auto *begin = bucket.entries;
+    auto *end = begin + bucket.count;
+    auto *found = std::find_if(begin, end, [valueHash](const Preferred &p) {
+        return p.valueHash == valueHash;
+    });
+    if (found == end) {
+        if (bucket.count < MaxPreferred) {
+            bucket.count++;
+        }
+        found = begin + bucket.count - 1;
+    }
+    // Most recently used first.
+    std::move_backward(begin, found, found + 1);
+    *begin = {index, valueHash};
+}
+
+const UserHistory::Bucket *UserHistory::findInTable(uint64_t keyHash) const {
+    if (!table_) {
+        return nullptr;
+    }
+    for (uint64_t i = keyHash & (capacity_ - 1), probe = 0; probe < capacity_;
+         i = (i + 1) & (capacity_ - 1), probe++) {
+        if (table_[i].keyHash == keyHash) {
+            return &table_[i];
+        }
+        if (table_[i].keyHash == 0) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+const UserHistory::Bucket *UserHistory::find(uint64_t keyHash) const {
+    if (auto iter = overlay_.find(keyHash); iter != overlay_.end()) {
+        return &iter->second;
+    }
+    return findInTable(keyHash);
+}
+
+size_t UserHistory::preferred(std::string_view key,
+                              Preferred (&result)[MaxPreferred]) const {
+    const auto *bucket = find(keyHashOf(key));
+    if (!bucket) {
+        return 0;
+    }
+    size_t count = std::min<size_t>(bucket->count, MaxPreferred);
+    std::copy_n(bucket->entries, count, result);
+    return count;
+}
+
+bool UserHistory::compact() {
+    if (tablePath_.empty() || overlay_.empty()) {
+        return true;
+    }
+    uint64_t count = overlay_.size();
+    for (uint64_t i = 0; i < capacity_; i++) {
+        if (table_[i].keyHash && !overlay_.count(table_[i].keyHash)) {
+            count++;
+        }
+    }
+    // Keep the load factor at most 1/2, so probing stays short.
+    uint64_t capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+
+    std::string image(sizeof(Header) + capacity * sizeof(Bucket), '\0');
+    Header header{};
+    memcpy(header.magic, historyMagic, sizeof(historyMagic));
+    header.version = historyVersion;
+    header.byteOrder = historyByteOrder;
+    header.capacity = capacity;
+    header.count = count;
+    memcpy(image.data(), &header, sizeof(header));
+    auto *buckets = reinterpret_cast<Bucket *>(image.data() + sizeof(Header));
+    auto insert = [buckets, capacity](const Bucket &bucket) {
+        auto i = bucket.keyHash & (capacity - 1);
+        while (buckets[i].keyHash) {
+            i = (i + 1) & (capacity - 1);
+        }
+        buckets[i] = bucket;
+    };
+    for (uint64_t i = 0; i < capacity_; i++) {
+        if (table_[i].keyHash && !overlay_.count(table_[i].keyHash)) {
+            insert(table_[i]);
+        }
+    }
+    for (const auto &[keyHash, bucket] : overlay_) {
+        insert(bucket);
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(
+        std::filesystem::path(tablePath_).parent_path(), ec);
+    auto tempPath = tablePath_ + ".tmp";
+    int fd = ::open(tempPath.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    bool success = writeAll(fd, image.data(), image.size()) && fsync(fd) == 0;
+    ::close(fd);
+    if (!success || rename(tempPath.c_str(), tablePath_.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    // Replaying the log again is harmless if truncating fails.
+    if (truncate(logPath_.c_str(), 0) != 0 && errno != ENOENT) {
+        return false;
+    }
+    overlay_.clear();
+    logEntries_ = 0;
+    map();
+    return true;
+}
+
+} // namespace fcitx
@@ -0,0 +1,89 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_HANGUL_USERHISTORY_H_
+#define _FCITX5_HANGUL_USERHISTORY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace fcitx {
+
+// Candidates selected by user, remembered per key.
+//
+// Selections are appended to a text log, which is merged into a binary hash
+// table once it grows. The table is memory mapped, and looking up a key costs
+// the same no matter how many keys are stored.
+class UserHistory {
+public:
+    // Number of remembered entries per key.
+    static constexpr size_t MaxPreferred = 4;
+
+    struct Preferred {
+        // Index of the entry among the dictionary entries of the key.
+        uint32_t index;
+        // valueHash() of the entry value, to detect dictionary changes.
+        uint32_t valueHash;
+    };
+
+    UserHistory();
+    ~UserHistory();
+    UserHistory(const UserHistory &) = delete;
+    UserHistory &operator=(const UserHistory &) = delete;
+
+    // Map the table at |table| and replay the log at |log| on top of it.
+    // Missing files are treated as empty.
+    void open(std::string table, std::string log);
+
+    // Record that value, the index-th entry of key, is selected, and append
+    // it to the log.
+    void add(std::string_view key, std::string_view value, uint32_t index);
+
+    // Fill the entries of key selected before, the most recent one first,
+    // and return the number of entries.
+    size_t preferred(std::string_view key,
+                     Preferred (&result)[MaxPreferred]) const;
+
+    static uint32_t valueHash(std::string_view value);
+
+    // Whether the log is long enough to be merged.
+    bool needCompact() const { return logEntries_ >= 256; }
+    // Merge the log into the table, then truncate the log.
+    bool compact();
+
+private:
+    struct Header;
+    struct Bucket {
+        uint64_t keyHash;
+        uint32_t count;
+        uint32_t reserved;
+        Preferred entries[MaxPreferred];
+    };
+
+    void close();
+    bool map();
+    void replayLog();
+    void update(uint64_t keyHash, uint32_t valueHash, uint32_t index);
+    const Bucket *findInTable(uint64_t keyHash) const;
+    const Bucket *find(uint64_t keyHash) const;
+
+    std::string tablePath_;
+    std::string logPath_;
+    void *mapped_ = nullptr;
+    size_t mappedSize_ = 0;
+    const Bucket *table_ = nullptr;
+    uint64_t capacity_ = 0;
+    // Keys changed since the table is written.
+    std::unordered_map<uint64_t, Bucket> overlay_;
+    size_t logEntries_ = 0;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_HANGUL_USERHISTORY_H_
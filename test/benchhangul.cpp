@@ -0,0 +1,288 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "hangul_public.h"
+#include "testdir.h"
+#include "testfrontend_public.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/capabilityflags.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputmethodgroup.h>
+#include <fcitx/inputmethodmanager.h>
+#include <fcitx/instance.h>
+#include <fcitx/surroundingtext.h>
+#include <fstream>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Replay key traces against every keyboard layout and option combination,
+// and report throughput, per key latency and allocations. Work the engine
+// leaves to the idle event loop is done after every key, and is counted in
+// throughput and allocations but not in key latency.
+//
+// Usage: benchhangul [number of keys] [trace file]
+// Without a trace file, a synthetic trace is generated. A trace file contains
+// one key per line in the format of fcitx::Key, lines starting with # are
+// ignored. The trace is repeated or cut to the requested number of keys.
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t /*size*/) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void *ptr, std::size_t /*size*/) noexcept {
+    std::free(ptr);
+}
+
+using namespace fcitx;
+
+namespace {
+
+const char *const keyboards[] = {"Dubeolsik",
+                                 "Dubeolsik Yetgeul",
+                                 "Sebeolsik 390",
+                                 "Sebeolsik Final",
+                                 "Sebeolsik Noshift",
+                                 "Sebeolsik Yetgeul",
+                                 "Sebeolsik Dubeol Layout",
+                                 "Romaja",
+                                 "Ahnmatae"};
+
+// Words of 1 to 4 syllables, with an occasional typo fixed by backspace and
+// an occasional hanja lookup.
+std::vector<Key> syntheticTrace(size_t length) {
+    static const std::string consonants = "rRseEfaqQtTdwWczxvg";
+    static const std::string vowels = "koiOjpuPhynbml";
+    std::mt19937 gen(20260101);
+    auto pick = [&gen](const std::string &chars) {
+        return Key(static_cast<KeySym>(
+            chars[std::uniform_int_distribution<size_t>(0, chars.size() - 1)(
+                gen)]));
+    };
+    auto chance = [&gen](int percent) {
+        return std::uniform_int_distribution<int>(0, 99)(gen) < percent;
+    };
+
+    std::vector<Key> trace;
+    trace.reserve(length + 16);
+    while (trace.size() < length) {
+        int syllables = std::uniform_int_distribution<int>(1, 4)(gen);
+        for (int i = 0; i < syllables; i++) {
+            trace.push_back(pick(consonants));
+            trace.push_back(pick(vowels));
+            if (chance(40)) {
+                trace.push_back(pick(consonants));
+            }
+            if (chance(5)) {
+                trace.push_back(Key(FcitxKey_BackSpace));
+            }
+        }
+        if (chance(10)) {
+            trace.push_back(Key(FcitxKey_F9));
+            trace.push_back(Key(FcitxKey_Escape));
+        }
+        trace.push_back(Key(chance(10) ? FcitxKey_period : FcitxKey_space));
+    }
+    trace.resize(length);
+    return trace;
+}
+
+std::vector<Key> loadTrace(const std::string &path) {
+    std::vector<Key> trace;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        Key key(line);
+        if (key.isValid()) {
+            trace.push_back(key);
+        }
+    }
+    return trace;
+}
+
+struct Result {
+    double keysPerSecond;
+    uint64_t p50, p90, p99, max;
+    double allocationsPerKey;
+};
+
+Result replay(AddonInstance *testfrontend, AddonInstance *hangul,
+              InputContext *ic, const std::vector<Key> &trace) {
+    std::vector<uint64_t> latency;
+    latency.reserve(trace.size());
+    auto allocationsBefore = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &key : trace) {
+        auto keyStart = std::chrono::steady_clock::now();
+        testfrontend->call<ITestFrontend::sendKeyEvent>(ic->uuid(), key,
+                                                        false);
+        latency.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - keyStart)
+                .count());
+        // Event loop would run here before the next key arrives.
+        hangul->call<IHangulEngine::runIdle>(ic);
+    }
+    auto total = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    auto allocated = allocations.load() - allocationsBefore;
+
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&latency](size_t p) {
+        return latency[std::min(latency.size() - 1, latency.size() * p / 100)];
+    };
+    return {static_cast<double>(trace.size()) / total,
+            percentile(50),
+            percentile(90),
+            percentile(99),
+            latency.back(),
+            static_cast<double>(allocated) / trace.size()};
+}
+
+void runBenchmark(Instance *instance, const std::vector<Key> &trace) {
+    auto *hangul = instance->addonManager().addon("hangul", true);
+    FCITX_ASSERT(hangul);
+    auto defaultGroup = instance->inputMethodManager().currentGroup();
+    defaultGroup.inputMethodList().clear();
+    defaultGroup.inputMethodList().push_back(
+        InputMethodGroupItem("keyboard-us"));
+    defaultGroup.inputMethodList().push_back(InputMethodGroupItem("hangul"));
+    defaultGroup.setDefaultInputMethod("");
+    instance->inputMethodManager().setGroup(defaultGroup);
+    auto *testfrontend = instance->addonManager().addon("testfrontend");
+    auto uuid = testfrontend->call<ITestFrontend::createInputContext>("bench");
+    auto *ic = instance->inputContextManager().findByUUID(uuid);
+    testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, Key("Control+space"),
+                                                    false);
+    FCITX_ASSERT(instance->inputMethod(ic) == "hangul");
+
+    std::printf("%-24s %4s %5s %5s %4s %10s %8s %8s %8s %8s %9s\n",
+                "keyboard", "word", "hanja", "surr", "auto", "keys/s",
+                "p50(ns)", "p90(ns)", "p99(ns)", "max(ns)", "alloc/key");
+    for (const auto *keyboard : keyboards) {
+        for (int options = 0; options < 16; options++) {
+            bool wordCommit = options & 1;
+            bool hanjaMode = options & 2;
+            bool surrounding = options & 4;
+            bool automaton = options & 8;
+            // Only these have a built-in automaton.
+            if (automaton && std::string_view(keyboard) != "Dubeolsik" &&
+                std::string_view(keyboard) != "Sebeolsik Final") {
+                continue;
+            }
+
+            RawConfig config;
+            config.setValueByPath("Keyboard", keyboard);
+            config.setValueByPath("WordCommit",
+                                  wordCommit ? "True" : "False");
+            config.setValueByPath("HanjaMode", hanjaMode ? "True" : "False");
+            config.setValueByPath("BuiltinAutomaton",
+                                  automaton ? "True" : "False");
+            hangul->setConfig(config);
+
+            CapabilityFlags flags = ic->capabilityFlags();
+            if (surrounding) {
+                flags |= CapabilityFlag::SurroundingText;
+                ic->surroundingText().setText("대한민국의 가능성", 9, 9);
+            } else {
+                flags = flags.unset(CapabilityFlag::SurroundingText);
+                ic->surroundingText().invalidate();
+            }
+            ic->setCapabilityFlags(flags);
+
+            // Make sure the tables are loaded before measuring.
+            for (const auto *key : {"r", "k", "F9", "Escape"}) {
+                testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, Key(key),
+                                                                false);
+            }
+            ic->reset();
+
+            auto result = replay(testfrontend, hangul, ic, trace);
+            ic->reset();
+            std::printf(
+                "%-24s %4d %5d %5d %4d %10.0f %8lu %8lu %8lu %8lu %9.2f\n",
+                keyboard, wordCommit, hanjaMode, surrounding, automaton,
+                result.keysPerSecond, static_cast<unsigned long>(result.p50),
+                static_cast<unsigned long>(result.p90),
+                static_cast<unsigned long>(result.p99),
+                static_cast<unsigned long>(result.max),
+                result.allocationsPerKey);
+        }
+    }
+    instance->deactivate();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    setupTestingEnvironmentPath(TESTING_BINARY_DIR, {"bin"},
+                                {TESTING_BINARY_DIR "/test"});
+    size_t length = argc > 1 ? std::stoul(argv[1]) : 5000;
+    FCITX_ASSERT(length > 0);
+    std::vector<Key> trace;
+    if (argc > 2) {
+        trace = loadTrace(argv[2]);
+        FCITX_ASSERT(!trace.empty()) << "No key in " << argv[2];
+        auto keys = trace.size();
+        for (size_t i = keys; i < length; i++) {
+            trace.push_back(trace[i % keys]);
+        }
+        trace.resize(length);
+    } else {
+        trace = syntheticTrace(length);
+    }
+
+    char arg0[] = "benchhangul";
+    char arg1[] = "--disable=all";
+    char arg2[] = "--enable=testim,testfrontend,hangul";
+    char *instanceArgv[] = {arg0, arg1, arg2};
+    fcitx::Log::setLogRule("default=3,hangul=3");
+    Instance instance(FCITX_ARRAY_SIZE(instanceArgv), instanceArgv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+    instance.eventDispatcher().schedule([&instance, &trace]() {
+        runBenchmark(&instance, trace);
+    });
+    instance.eventDispatcher().schedule([&instance]() { instance.exit(); });
+    instance.exec();
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "hanjadict.h"
+#include "testdir.h"
+#include "testfrontend_public.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputcontextmanager.h>
+#include <fcitx/inputmethodgroup.h>
+#include <fcitx/inputmethodmanager.h>
+#include <fcitx/instance.h>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Report the time to load the addon and the tables, and the memory used by
+// the tables and by each input context. Memory of an input context is the
+// part over the one of an input context using keyboard-us, so it only counts
+// what the addon keeps for it. Fail if any of them is well over what it
+// should be.
+//
+// Times are compared in units of the time to compile data/symbol.txt in the
+// same process, so the limits hold for debug, sanitizer and optimized builds
+// and for slow machines alike. Measured on x86_64 with hangulcore, for a 5 MiB
+// image compiled from symbol.txt and a hanja.txt of libhangul's size:
+// - compiling symbol.txt: 0.4 ms with -O2, 8 ms with ASan at -O0;
+// - opening and validating the image plus the history: 0.3 ms with -O2,
+//   7.5 ms with ASan, so about one unit, and 4.1 MiB of RSS, 0.8 of the
+//   image size, since validation reads the whole image.
+
+using namespace fcitx;
+
+namespace {
+
+// Measured as one unit, the rest is starting the loading thread and the
+// user dictionary.
+constexpr double MaxTableLoadUnits = 20;
+// Not measured here, it is mostly loading the shared libraries and the
+// config. 250 units is 0.1 s for an optimized build and 2 s with ASan.
+constexpr double MaxAddonLoadUnits = 250;
+// Measured as 0.8 of the image, the margin covers the history, the user
+// dictionary and the stack of the loading thread.
+constexpr double MaxTableRSSPerImageByte = 1.5;
+constexpr uint64_t TableRSSMargin = 2 << 20;
+// Not measured here. A composing hangul context holds a libhangul context,
+// the preedit and a few scratch strings, which should stay under what fcitx
+// itself keeps for an input context.
+constexpr double MaxStateRSSPerInputContext = 1;
+
+constexpr size_t InputContextCounts[] = {10, 100, 1000, 4000};
+
+uint64_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+uint64_t residentGrowth(uint64_t before) {
+    auto after = residentBytes();
+    return after > before ? after - before : 0;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+void sendKeys(AddonInstance *testfrontend, ICUUID uuid,
+              std::initializer_list<const char *> keys) {
+    for (const auto *key : keys) {
+        testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, Key(key), false);
+    }
+}
+
+// Time unit of the limits.
+double calibrationSeconds() {
+    double best = 0;
+    for (int i = 0; i < 5; i++) {
+        auto start = std::chrono::steady_clock::now();
+        auto image =
+            HanjaDictionary::compile(TESTING_SOURCE_DIR "/data/symbol.txt");
+        auto seconds = secondsSince(start);
+        FCITX_ASSERT(image);
+        best = i ? std::min(best, seconds) : seconds;
+    }
+    return best;
+}
+
+uint64_t fileSize(const char *path) {
+    struct stat st;
+    FCITX_ASSERT(stat(path, &st) == 0) << path;
+    return st.st_size;
+}
+
+// Create input contexts using inputMethod up to every count in
+// InputContextCounts, type keys in each, and return the average memory of
+// each at the last count.
+uint64_t inputContextRSS(Instance *instance, AddonInstance *testfrontend,
+                         const std::string &inputMethod,
+                         std::initializer_list<const char *> keys) {
+    size_t count = 0;
+    auto rss = residentBytes();
+    uint64_t result = 0;
+    for (auto target : InputContextCounts) {
+        for (; count < target; count++) {
+            auto uuid = testfrontend->call<ITestFrontend::createInputContext>(
+                "testapp");
+            auto *ic = instance->inputContextManager().findByUUID(uuid);
+            instance->setCurrentInputMethod(ic, inputMethod, true);
+            FCITX_ASSERT(instance->inputMethod(ic) == inputMethod);
+            sendKeys(testfrontend, uuid, keys);
+        }
+        result = residentGrowth(rss) / count;
+        std::printf("%zu %s input contexts: %lu bytes each\n", count,
+                    inputMethod.c_str(), static_cast<unsigned long>(result));
+    }
+    return result;
+}
+
+void scheduleEvent(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto unit = calibrationSeconds();
+        std::printf("unit: %.3f ms\n", unit * 1000);
+
+        auto rss = residentBytes();
+        auto start = std::chrono::steady_clock::now();
+        auto *hangul = instance->addonManager().addon("hangul", true);
+        auto addonLoad = secondsSince(start);
+        FCITX_ASSERT(hangul);
+        std::printf("addon: %.3f s, %lu KiB\n", addonLoad,
+                    static_cast<unsigned long>(residentGrowth(rss) >> 10));
+
+        auto defaultGroup = instance->inputMethodManager().currentGroup();
+        defaultGroup.inputMethodList().clear();
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("keyboard-us"));
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("hangul"));
+        defaultGroup.setDefaultInputMethod("");
+        instance->inputMethodManager().setGroup(defaultGroup);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        sendKeys(testfrontend, uuid, {"Control+space", "r", "k"});
+        FCITX_ASSERT(instance->inputMethod(ic) == "hangul");
+
+        // Hanja key waits for the tables.
+        rss = residentBytes();
+        start = std::chrono::steady_clock::now();
+        sendKeys(testfrontend, uuid, {"F9"});
+        auto tableLoad = secondsSince(start);
+        auto tableRSS = residentGrowth(rss);
+        sendKeys(testfrontend, uuid, {"Escape"});
+        ic->reset();
+        std::printf("tables: %.3f s, %lu KiB\n", tableLoad,
+                    static_cast<unsigned long>(tableRSS >> 10));
+
+        // Every hangul input context is composing, so all of its state is
+        // in use.
+        auto baseline =
+            inputContextRSS(instance, testfrontend, "keyboard-us", {});
+        auto hangulRSS =
+            inputContextRSS(instance, testfrontend, "hangul", {"r", "k"});
+        auto stateRSS = hangulRSS > baseline ? hangulRSS - baseline : 0;
+        std::printf("hangul state: %lu bytes each\n",
+                    static_cast<unsigned long>(stateRSS));
+
+        auto imageSize = fileSize(TESTING_BINARY_DIR "/test/hangul/table.dict");
+        FCITX_ASSERT(addonLoad < MaxAddonLoadUnits * unit) << addonLoad;
+        FCITX_ASSERT(tableLoad < MaxTableLoadUnits * unit) << tableLoad;
+        FCITX_ASSERT(tableRSS <
+                     MaxTableRSSPerImageByte * imageSize + TableRSSMargin)
+            << tableRSS;
+        FCITX_ASSERT(stateRSS < MaxStateRSSPerInputContext * baseline)
+            << stateRSS;
+    });
+
+    instance->eventDispatcher().schedule([instance]() { instance->exit(); });
+}
+
+} // namespace
+
+int main() {
+    setupTestingEnvironmentPath(TESTING_BINARY_DIR, {"bin"},
+                                {TESTING_BINARY_DIR "/test"});
+    char arg0[] = "testfootprint";
+    char arg1[] = "--disable=all";
+    char arg2[] = "--enable=testim,testfrontend,hangul";
+    char *argv[] = {arg0, arg1, arg2};
+    fcitx::Log::setLogRule("default=3,hangul=3");
+    Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+    scheduleEvent(&instance);
+    instance.exec();
+
+    return 0;
+}
@@ -4,8 +4,11 @@
  * SPDX-License-Identifier: GPL-2.0-or-later
  *
  */
+#include "hangul_public.h"
 #include "testdir.h"
 #include "testfrontend_public.h"
+#include <algorithm>
+#include <fcitx-config/rawconfig.h>
 #include <fcitx-utils/eventdispatcher.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
@@ -17,6 +20,8 @@
 #include <fcitx/inputmethodmanager.h>
 #include <fcitx/inputpanel.h>
 #include <fcitx/instance.h>
+#include <string>
+#include <vector>
 
 using namespace fcitx;
 
@@ -51,6 +56,64 @@ void scheduleEvent(Instance *instance) {
         FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
             uuid, Key(FcitxKey_Q, KeyState::CapsLock), false));
         instance->deactivate();
+
+        // Batch only commits once.
+        uuid = testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "hangul");
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("가나 ");
+        hangul->call<IHangulEngine::processKeys>(
+            ic, std::vector<Key>{Key("r"), Key("k"), Key("s"), Key("k"),
+                                 Key("space")});
+        FCITX_ASSERT(ic->inputPanel().clientPreedit().toString().empty());
+        instance->deactivate();
+
+        // Word commit keeps the whole sentence, and edits at the cursor.
+        RawConfig config;
+        config.setValueByPath("WordCommit", "True");
+        hangul->setConfig(config);
+        uuid = testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        std::string sentence;
+        std::vector<Key> keys;
+        for (int i = 0; i < 50; i++) {
+            sentence.append("가");
+            keys.insert(keys.end(), {Key("r"), Key("k")});
+        }
+        testfrontend->call<ITestFrontend::pushCommitExpectation>("다" +
+                                                                 sentence);
+        for (const auto &key : keys) {
+            FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, key, false));
+        }
+        for (int i = 0; i < 50; i++) {
+            FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, Key("Left"), false));
+        }
+        for (const auto *key : {"e", "k", "space"}) {
+            testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, Key(key),
+                                                            false);
+        }
+        config.setValueByPath("WordCommit", "False");
+        hangul->setConfig(config);
+        instance->deactivate();
+
+        // Dictionary lookup for other addons.
+        auto entries = hangul->call<IHangulEngine::lookupExact>("ㄱ");
+        FCITX_ASSERT(std::any_of(entries.begin(), entries.end(),
+                                 [](const HangulDictionaryEntry &entry) {
+                                     return entry.key == "ㄱ" &&
+                                            entry.value == "！";
+                                 }));
+        entries = hangul->call<IHangulEngine::lookupSuffix>("가ㄱ");
+        FCITX_ASSERT(!entries.empty() && entries[0].key == "ㄱ");
+        entries = hangul->call<IHangulEngine::lookupPrefix>("ㄱ가");
+        FCITX_ASSERT(!entries.empty() && entries[0].key == "ㄱ");
+        FCITX_ASSERT(hangul->call<IHangulEngine::lookupExact>("없음").empty());
     });
 
     instance->eventDispatcher().schedule([instance]() { instance->exit(); });
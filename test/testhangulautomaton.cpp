@@ -0,0 +1,188 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "hangulautomaton.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/misc.h>
+#include <hangul.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace fcitx;
+
+// Type random keys to both the automaton and libhangul, and check that
+// every step gives the same result.
+
+namespace {
+
+constexpr int Backspace = -1;
+constexpr int Flush = -2;
+
+std::u32string toString(const uint32_t *str) {
+    std::u32string result;
+    for (; str && *str; ++str) {
+        result.push_back(*str);
+    }
+    return result;
+}
+
+#if !defined(FCITX_HANGUL_VERSION_0_2)
+// Same as the transition callback of the engine.
+bool noReorder(HangulInputContext *hic, ucschar c, const ucschar * /*unused*/,
+               void * /*unused*/) {
+    if (hangul_is_choseong(c) &&
+        (hangul_ic_has_jungseong(hic) || hangul_ic_has_jongseong(hic))) {
+        return false;
+    }
+    if (hangul_is_jungseong(c) && hangul_ic_has_jongseong(hic)) {
+        return false;
+    }
+    return true;
+}
+#endif
+
+UniqueCPtr<HangulInputContext, &hangul_ic_delete>
+newContext(const char *keyboard, HangulAutomaton::Options options) {
+    UniqueCPtr<HangulInputContext, &hangul_ic_delete> hic(
+        hangul_ic_new(keyboard));
+#if defined(FCITX_HANGUL_VERSION_0_2)
+    hangul_ic_set_option(hic.get(), HANGUL_IC_OPTION_AUTO_REORDER,
+                         options.autoReorder);
+    hangul_ic_set_option(hic.get(), HANGUL_IC_OPTION_COMBI_ON_DOUBLE_STROKE,
+                         options.combiOnDoubleStroke);
+#else
+    if (!options.autoReorder) {
+        hangul_ic_connect_callback(hic.get(), "transition",
+                                   reinterpret_cast<void *>(&noReorder),
+                                   nullptr);
+    }
+#endif
+    return hic;
+}
+
+std::vector<int> randomKeys(size_t length) {
+    std::mt19937 gen(20260301);
+    std::uniform_int_distribution<int> ascii(0x21, 0x7e);
+    std::uniform_int_distribution<int> percent(0, 99);
+    // Mostly letters, which are jamo in both layouts.
+    const std::string letters = "rRseEfaqQtTdwWczxvgkoiOjpuPhynbml";
+    std::uniform_int_distribution<size_t> letter(0, letters.size() - 1);
+    std::vector<int> keys;
+    for (size_t i = 0; i < length; i++) {
+        auto p = percent(gen);
+        if (p < 5) {
+            keys.push_back(Backspace);
+        } else if (p < 7) {
+            keys.push_back(Flush);
+        } else if (p < 75) {
+            keys.push_back(letters[letter(gen)]);
+        } else {
+            keys.push_back(ascii(gen));
+        }
+    }
+    return keys;
+}
+
+void testDifferential(const char *keyboard, HangulAutomaton::Options options,
+                      const std::vector<int> &keys) {
+    const auto *layout = HangulAutomaton::layout(keyboard);
+    FCITX_ASSERT(layout);
+    HangulAutomaton automaton(layout, options);
+    auto hic = newContext(keyboard, options);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto key = keys[i];
+        if (key == Flush) {
+            FCITX_ASSERT(toString(automaton.flush()) ==
+                         toString(hangul_ic_flush(hic.get())))
+                << keyboard << " " << i;
+        } else {
+            bool expect = key == Backspace
+                              ? hangul_ic_backspace(hic.get())
+                              : hangul_ic_process(hic.get(), key);
+            bool result = key == Backspace ? automaton.backspace()
+                                           : automaton.process(key);
+            FCITX_ASSERT(result == expect) << keyboard << " " << i;
+            FCITX_ASSERT(toString(automaton.commitString()) ==
+                         toString(hangul_ic_get_commit_string(hic.get())))
+                << keyboard << " " << i;
+        }
+        FCITX_ASSERT(toString(automaton.preeditString()) ==
+                     toString(hangul_ic_get_preedit_string(hic.get())))
+            << keyboard << " " << i;
+        FCITX_ASSERT(automaton.isEmpty() == hangul_ic_is_empty(hic.get()))
+            << keyboard << " " << i;
+        FCITX_ASSERT(automaton.hasJungseong() ==
+                     hangul_ic_has_jungseong(hic.get()))
+            << keyboard << " " << i;
+        FCITX_ASSERT(automaton.hasJongseong() ==
+                     hangul_ic_has_jongseong(hic.get()))
+            << keyboard << " " << i;
+    }
+}
+
+// Not a pass or fail test, only reported for comparison.
+void reportSpeed(const char *keyboard, const std::vector<int> &keys) {
+    auto time = [&keys](auto &&process) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto key : keys) {
+            process(key);
+        }
+        return std::chrono::duration<double, std::nano>(
+                   std::chrono::steady_clock::now() - start)
+                   .count() /
+               keys.size();
+    };
+
+    HangulAutomaton automaton(HangulAutomaton::layout(keyboard), {});
+    auto hic = newContext(keyboard, {});
+    auto automatonTime = time([&automaton](int key) {
+        if (key == Backspace) {
+            automaton.backspace();
+        } else if (key == Flush) {
+            automaton.flush();
+        } else {
+            automaton.process(key);
+        }
+    });
+    auto hangulTime = time([&hic](int key) {
+        if (key == Backspace) {
+            hangul_ic_backspace(hic.get());
+        } else if (key == Flush) {
+            hangul_ic_flush(hic.get());
+        } else {
+            hangul_ic_process(hic.get(), key);
+        }
+    });
+    std::printf("%s: automaton %.1f ns/key, libhangul %.1f ns/key\n", keyboard,
+                automatonTime, hangulTime);
+}
+
+} // namespace
+
+int main() {
+    FCITX_ASSERT(!HangulAutomaton::layout("ro"));
+
+    auto keys = randomKeys(200000);
+    for (const char *keyboard : {"2", "3f"}) {
+        for (bool autoReorder : {true, false}) {
+#if defined(FCITX_HANGUL_VERSION_0_2)
+            for (bool combiOnDoubleStroke : {true, false}) {
+                testDifferential(keyboard, {autoReorder, combiOnDoubleStroke},
+                                 keys);
+            }
+#else
+            testDifferential(keyboard, {autoReorder, true}, keys);
+#endif
+        }
+        reportSpeed(keyboard, keys);
+    }
+    return 0;
+}
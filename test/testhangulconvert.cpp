@@ -0,0 +1,100 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "testdir.h"
+#include <cstdlib>
+#include <fcitx-utils/log.h>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+// Run hangul-convert, whose path is the first argument, on files and check
+// the output.
+
+namespace {
+
+const std::string testDir = TESTING_BINARY_DIR "/test/";
+
+std::string convertTool;
+
+void writeFile(const std::string &path, const std::string &content) {
+    std::ofstream out(path, std::ios::out | std::ios::binary |
+                                std::ios::trunc);
+    out << content;
+}
+
+std::string readFile(const std::string &path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    return {std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>()};
+}
+
+std::string convert(const std::string &args) {
+    auto output = testDir + "testhangulconvert.out";
+    auto command = convertTool + " " + args + " > " + output;
+    FCITX_ASSERT(std::system(command.c_str()) == 0) << command;
+    return readFile(output);
+}
+
+// Input of several chunks, converted by one and by many threads.
+void testOrder() {
+    std::mt19937 gen(20260501);
+    const char *words[] = {"dkssudgktpdy", "gksrnr", "rkskek", "123", "QWER"};
+    std::uniform_int_distribution<size_t> word(0, std::size(words) - 1);
+    std::string input;
+    while (input.size() < (4 << 20)) {
+        for (int i = 0; i < 8; i++) {
+            input.append(words[word(gen)]).push_back(' ');
+        }
+        input.back() = '\n';
+    }
+    auto path = testDir + "testhangulconvert.txt";
+    writeFile(path, input);
+
+    auto single = convert("-k 2 -j 1 " + path);
+    FCITX_ASSERT(single.size() > input.size() / 2);
+    FCITX_ASSERT(single.find("안녕하세요") != std::string::npos);
+    FCITX_ASSERT(convert("-k 2 -j 8 " + path) == single);
+    // Built-in automaton gives the same result as libhangul.
+    FCITX_ASSERT(convert("-k 2 -a -j 8 " + path) == single);
+}
+
+// Last line of a file doesn't join the first line of the next file.
+void testFiles() {
+    auto first = testDir + "testhangulconvert1.txt";
+    auto second = testDir + "testhangulconvert2.txt";
+    writeFile(first, "r");
+    writeFile(second, "k\n");
+    FCITX_ASSERT(convert("-k 2 " + first + " " + second) == "ㄱㅏ\n");
+}
+
+void testHanja() {
+    auto source = testDir + "testhangulconvert-dict.txt";
+    auto path = testDir + "testhangulconvert-hanja.txt";
+    writeFile(source, "한국:韓國:\n"
+                      "한:韓:\n");
+    writeFile(path, "한국 사람\n");
+    FCITX_ASSERT(convert("-c -d " + source + " " + path) == "韓國 사람\n");
+    FCITX_ASSERT(convert("-n -d " + source + " " + path) ==
+                 "한국(韓國) 사람\n");
+    // Shorter words are only converted if asked.
+    writeFile(path, "한 사람\n");
+    FCITX_ASSERT(convert("-c -d " + source + " " + path) == "한 사람\n");
+    FCITX_ASSERT(convert("-c -l 1 -d " + source + " " + path) ==
+                 "韓 사람\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    FCITX_ASSERT(argc == 2);
+    convertTool = argv[1];
+    testOrder();
+    testFiles();
+    testHanja();
+    return 0;
+}
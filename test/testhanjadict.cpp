@@ -0,0 +1,213 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "hanjadict.h"
+#include "testdir.h"
+#include <cstdint>
+#include <cstring>
+#include <fcitx-utils/log.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+
+using namespace fcitx;
+
+namespace {
+
+const std::string testSource = TESTING_BINARY_DIR "/test/testhanjadict.txt";
+const std::string testImage = TESTING_BINARY_DIR "/test/testhanjadict.dict";
+const std::string testSource2 = TESTING_BINARY_DIR "/test/testhanjadict2.txt";
+
+void writeFile(const std::string &path, const std::string &content) {
+    std::ofstream out(path, std::ios::out | std::ios::binary |
+                                std::ios::trunc);
+    out << content;
+}
+
+std::string readFile(const std::string &path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    return {std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>()};
+}
+
+void testSymbol() {
+    auto image = HanjaDictionary::compile(TESTING_SOURCE_DIR
+                                          "/data/symbol.txt");
+    FCITX_ASSERT(image);
+    HanjaDictionary dict;
+    FCITX_ASSERT(dict.load(std::move(*image)));
+    auto list = dict.matchExact("ㄱ");
+    FCITX_ASSERT(list.size() > 10) << list.size();
+    FCITX_ASSERT(list.key(0) == "ㄱ");
+    FCITX_ASSERT(list.value(0) == "\xe3\x80\x80");
+    FCITX_ASSERT(list.value(1) == "！");
+    FCITX_ASSERT(dict.matchExact("ㄱㄱ").empty());
+    auto suffix = dict.matchSuffix("ㄱㄱ");
+    FCITX_ASSERT(suffix.size() == list.size());
+    FCITX_ASSERT(suffix.value(1) == "！");
+}
+
+void testMatch() {
+    writeFile(testSource, "# comment\n"
+                          "\n"
+                          "능:能:능할 능\n"
+                          "가:家:집 가\n"
+                          "가능:可能:\n"
+                          "가:假:거짓 가\n"
+                          "bad line\n"
+                          "나:那:어찌 나:\n");
+    auto image = HanjaDictionary::compile(testSource);
+    FCITX_ASSERT(image);
+    writeFile(testImage, *image);
+
+    HanjaDictionary dict;
+    FCITX_ASSERT(dict.open(testImage, testSource));
+    FCITX_ASSERT(dict.keyCount() == 4) << dict.keyCount();
+    FCITX_ASSERT(dict.entryCount() == 5) << dict.entryCount();
+
+    // Touched source is hashed once, then its new mtime is recorded.
+    struct timespec times[2] = {{1000000, 0}, {1000000, 0}};
+    FCITX_ASSERT(utimensat(AT_FDCWD, testSource.c_str(), times, 0) == 0);
+    FCITX_ASSERT(dict.open(testImage, testSource));
+    FCITX_ASSERT(readFile(testImage) != *image);
+    FCITX_ASSERT(dict.open(testImage, testSource));
+    FCITX_ASSERT(dict.keyCount() == 4) << dict.keyCount();
+    FCITX_ASSERT(dict.maxKeyLength() == 2) << dict.maxKeyLength();
+
+    auto exact = dict.matchExact("가");
+    FCITX_ASSERT(exact.size() == 2);
+    FCITX_ASSERT(exact.value(0) == "家");
+    FCITX_ASSERT(exact.comment(0) == "집 가");
+    FCITX_ASSERT(exact.value(1) == "假");
+    FCITX_ASSERT(dict.matchExact("나").comment(0) == "어찌 나:");
+
+    auto prefix = dict.matchPrefix("가능성");
+    FCITX_ASSERT(prefix.size() == 3);
+    FCITX_ASSERT(prefix.key(0) == "가능");
+    FCITX_ASSERT(prefix.value(0) == "可能");
+    FCITX_ASSERT(prefix.key(2) == "가");
+    FCITX_ASSERT(prefix.value(2) == "假");
+    FCITX_ASSERT(prefix.value(3).empty());
+
+    auto suffix = dict.matchSuffix("가능");
+    FCITX_ASSERT(suffix.size() == 2);
+    FCITX_ASSERT(suffix.value(0) == "可能");
+    FCITX_ASSERT(suffix.value(1) == "能");
+
+    // Only the keys ending the string are matched, no matter how long it is.
+    suffix = dict.matchSuffix("아무 말이나 다 가능");
+    FCITX_ASSERT(suffix.size() == 2);
+    FCITX_ASSERT(suffix.key(0) == "가능");
+    FCITX_ASSERT(suffix.key(1) == "능");
+    FCITX_ASSERT(dict.matchSuffix("가능한").empty());
+
+    // Cursor gives the same result as matchPrefix while typing and erasing.
+    HanjaPrefixCursor cursor;
+    for (const auto *key :
+         {"가", "가느", "가능", "가능성", "가능", "가", "", "능", "가능"}) {
+        auto expect = dict.matchPrefix(key);
+        auto result = cursor.match(&dict, key);
+        FCITX_ASSERT(result.size() == expect.size()) << key;
+        for (size_t i = 0; i < expect.size(); i++) {
+            FCITX_ASSERT(result.key(i) == expect.key(i)) << key;
+            FCITX_ASSERT(result.value(i) == expect.value(i)) << key;
+        }
+    }
+
+    // Promoted entries come first, others keep their order.
+    prefix.promote({2, 0, 2, 9});
+    FCITX_ASSERT(prefix.size() == 3);
+    FCITX_ASSERT(prefix.value(0) == "假");
+    FCITX_ASSERT(prefix.value(1) == "可能");
+    FCITX_ASSERT(prefix.value(2) == "家");
+    FCITX_ASSERT(prefix.entryIndex(0) == 1);
+    FCITX_ASSERT(prefix.keyCount() == 2);
+    FCITX_ASSERT(prefix.keyEntryCount(1) == 2);
+    FCITX_ASSERT(prefix != dict.matchPrefix("가능성"));
+
+    // Image is rejected once the source changes.
+    writeFile(testSource, "가:家:\n");
+    FCITX_ASSERT(!dict.open(testImage, testSource));
+    FCITX_ASSERT(!dict.isValid());
+    FCITX_ASSERT(dict.matchExact("가").empty());
+}
+
+void testSources() {
+    writeFile(testSource2, "ㄱ:！:\n"
+                           "가:加:더할 가\n");
+    writeFile(testSource, "가:家:집 가\n"
+                          "가능:可能:\n");
+    auto image = HanjaDictionary::compile({testSource2, testSource});
+    FCITX_ASSERT(image);
+    writeFile(testImage, *image);
+
+    HanjaDictionary dict;
+    FCITX_ASSERT(dict.open(testImage, {testSource2, testSource}));
+    // Order of sources is part of the image.
+    FCITX_ASSERT(!HanjaDictionary().open(testImage, {testSource, testSource2}));
+    FCITX_ASSERT(!HanjaDictionary().open(testImage, testSource));
+
+    auto prefix = dict.matchPrefix("가능");
+    FCITX_ASSERT(prefix.size() == 3);
+    FCITX_ASSERT(prefix.value(0) == "可能");
+    FCITX_ASSERT(prefix.source(0) == 1);
+    FCITX_ASSERT(prefix.value(1) == "加");
+    FCITX_ASSERT(prefix.source(1) == 0);
+    FCITX_ASSERT(prefix.value(2) == "家");
+    FCITX_ASSERT(prefix.source(2) == 1);
+    FCITX_ASSERT(dict.matchExact("ㄱ").source(0) == 0);
+}
+
+// Look up everything in a damaged image, which must either fail to load or
+// only return what is in it.
+void testCorrupt() {
+    writeFile(testSource, "가:家:집 가\n"
+                          "가능:可能:\n"
+                          "능:能:능할 능\n");
+    auto image = HanjaDictionary::compile(testSource);
+    FCITX_ASSERT(image);
+    FCITX_ASSERT(!HanjaDictionary().load(image->substr(0, image->size() - 1)));
+
+    std::mt19937 gen(20260601);
+    std::uniform_int_distribution<size_t> offset(0, image->size() / 4 - 1);
+    std::uniform_int_distribution<uint32_t> value;
+    size_t loaded = 0;
+    for (int i = 0; i < 20000; i++) {
+        auto damaged = *image;
+        auto word = value(gen) >> (value(gen) % 32);
+        std::memcpy(damaged.data() + offset(gen) * 4, &word, sizeof(word));
+        HanjaDictionary dict;
+        if (!dict.load(std::move(damaged))) {
+            continue;
+        }
+        loaded++;
+        for (const auto &list :
+             {dict.matchExact("가"), dict.matchPrefix("가능성"),
+              dict.matchSuffix("가능")}) {
+            for (size_t j = 0; j < list.size(); j++) {
+                FCITX_ASSERT(list.key(j).size() + list.value(j).size() +
+                                 list.comment(j).size() <=
+                             image->size());
+                FCITX_ASSERT(list.source(j) == 0);
+            }
+        }
+    }
+    // Damage in strings is not detected.
+    FCITX_ASSERT(loaded > 0);
+}
+
+} // namespace
+
+int main() {
+    testSymbol();
+    testMatch();
+    testSources();
+    testCorrupt();
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "preeditbuffer.h"
+#include <cstdint>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/utf8.h>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace fcitx;
+
+// Edit the buffer and a plain string the same way, and compare them after
+// every step.
+
+namespace {
+
+std::u32string toString(const PreeditBuffer &buffer) {
+    std::u32string result;
+    for (size_t i = 0; i < buffer.size(); i++) {
+        result.push_back(buffer[i]);
+    }
+    return result;
+}
+
+std::string toUTF8(std::u32string_view str) {
+    std::string result;
+    for (auto c : str) {
+        result.append(utf8::UCS4ToUTF8(c));
+    }
+    return result;
+}
+
+// UTF-8 text matches the characters on both sides of the cursor.
+bool checkUTF8(const PreeditBuffer &buffer) {
+    auto text = toString(buffer);
+    std::u32string_view view = text;
+    return buffer.textBefore() == toUTF8(view.substr(0, buffer.cursor())) &&
+           buffer.textAfter() == toUTF8(view.substr(buffer.cursor()));
+}
+
+void testEdit() {
+    PreeditBuffer buffer;
+    FCITX_ASSERT(buffer.empty());
+    FCITX_ASSERT(!buffer.backspace());
+    FCITX_ASSERT(!buffer.moveLeft());
+    FCITX_ASSERT(!buffer.moveRight());
+
+    const uint32_t text[] = {U'가', U'나', U'다', 0};
+    buffer.insert(text);
+    FCITX_ASSERT(toString(buffer) == U"가나다");
+    FCITX_ASSERT(buffer.cursor() == 3);
+    FCITX_ASSERT(buffer.moveLeft());
+    FCITX_ASSERT(buffer.moveLeft());
+    const uint32_t middle[] = {U'라', 0};
+    buffer.insert(middle);
+    FCITX_ASSERT(toString(buffer) == U"가라나다");
+    FCITX_ASSERT(buffer.cursor() == 2);
+    FCITX_ASSERT(buffer.textBefore() == "가라");
+    FCITX_ASSERT(buffer.textAfter() == "나다");
+    FCITX_ASSERT(buffer.backspace());
+    FCITX_ASSERT(toString(buffer) == U"가나다");
+
+    // Front is removed, cursor stays with the text after it.
+    buffer.eraseFront(1);
+    FCITX_ASSERT(toString(buffer) == U"나다");
+    FCITX_ASSERT(buffer.cursor() == 0);
+    FCITX_ASSERT(buffer.moveRight());
+    buffer.eraseFront(10);
+    FCITX_ASSERT(buffer.empty());
+    FCITX_ASSERT(buffer.cursor() == 0);
+    buffer.insert(text);
+    buffer.clear();
+    FCITX_ASSERT(buffer.empty());
+    FCITX_ASSERT(buffer.textBefore().empty());
+    buffer.release();
+    FCITX_ASSERT(buffer.empty());
+}
+
+// Walk the cursor through a long text and remove it from the front, which
+// makes the UTF-8 text move between both sides and lose its front often.
+void testLong() {
+    PreeditBuffer buffer;
+    std::vector<uint32_t> text;
+    for (uint32_t i = 0; i < 20000; i++) {
+        text.push_back(i % 2 ? 0xAC00 + i % 11172 : 0x20 + i % 0x5f);
+    }
+    text.push_back(0);
+    buffer.insert(text.data());
+    while (buffer.moveLeft()) {
+    }
+    FCITX_ASSERT(buffer.textBefore().empty());
+    FCITX_ASSERT(checkUTF8(buffer));
+    for (int i = 0; i < 5000; i++) {
+        buffer.moveRight();
+    }
+    while (!buffer.empty()) {
+        buffer.eraseFront(3);
+        buffer.moveRight();
+        if (buffer.size() % 1000 < 4) {
+            FCITX_ASSERT(checkUTF8(buffer)) << buffer.size();
+        }
+    }
+    FCITX_ASSERT(buffer.textAfter().empty());
+}
+
+void testRandom() {
+    std::mt19937 gen(20260401);
+    std::uniform_int_distribution<int> action(0, 9);
+    // Characters of every UTF-8 length.
+    std::uniform_int_distribution<int> range(0, 3);
+    const std::pair<uint32_t, uint32_t> ranges[] = {
+        {0x20, 0x7E}, {0xA0, 0x7FF}, {0xAC00, 0xD7A3}, {0x20000, 0x2A6DF}};
+    PreeditBuffer buffer;
+    std::u32string expect;
+    size_t cursor = 0;
+    for (int i = 0; i < 100000; i++) {
+        switch (action(gen)) {
+        case 0:
+            FCITX_ASSERT(buffer.backspace() == (cursor > 0));
+            if (cursor > 0) {
+                expect.erase(--cursor, 1);
+            }
+            break;
+        case 1:
+            FCITX_ASSERT(buffer.moveLeft() == (cursor > 0));
+            cursor -= cursor > 0;
+            break;
+        case 2:
+            FCITX_ASSERT(buffer.moveRight() == (cursor < expect.size()));
+            cursor += cursor < expect.size();
+            break;
+        case 3: {
+            auto n = std::min<size_t>(expect.size(), action(gen));
+            buffer.eraseFront(n);
+            expect.erase(0, n);
+            cursor = cursor > n ? cursor - n : 0;
+            break;
+        }
+        default: {
+            auto [first, last] = ranges[range(gen)];
+            std::uniform_int_distribution<uint32_t> character(first, last);
+            const uint32_t str[] = {character(gen), 0};
+            buffer.insert(str);
+            expect.insert(cursor++, 1, str[0]);
+            break;
+        }
+        }
+        FCITX_ASSERT(toString(buffer) == expect) << i;
+        FCITX_ASSERT(buffer.cursor() == cursor) << i;
+        // Converting the whole text is slow, so only check it now and then.
+        if (i % 64 == 0) {
+            FCITX_ASSERT(checkUTF8(buffer)) << i;
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    testEdit();
+    testLong();
+    testRandom();
+    return 0;
+}
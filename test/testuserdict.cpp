@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "hanjadict.h"
+#include "testdir.h"
+#include "userdict.h"
+#include <fcitx-utils/log.h>
+#include <fstream>
+#include <string>
+
+using namespace fcitx;
+
+namespace {
+
+const std::string testSource = TESTING_BINARY_DIR "/test/testuserdict.txt";
+const std::string testUser = TESTING_BINARY_DIR "/test/testuserdict-user.txt";
+
+void writeFile(const std::string &path, const std::string &content) {
+    std::ofstream out(path, std::ios::out | std::ios::binary |
+                                std::ios::trunc);
+    out << content;
+}
+
+void load(UserDictionary &user, const std::string &content,
+          size_t expectChanges) {
+    writeFile(testUser, content);
+    auto changes = user.diff(UserDictionary::read(testUser));
+    FCITX_ASSERT(changes.size() == expectChanges) << changes.size();
+    user.apply(std::move(changes));
+}
+
+void testOverlay() {
+    writeFile(testSource, "가:家:집 가\n"
+                          "가능:可能:\n"
+                          "능:能:능할 능\n");
+    auto image = HanjaDictionary::compile(testSource);
+    FCITX_ASSERT(image);
+    HanjaDictionary dict;
+    FCITX_ASSERT(dict.load(std::move(*image)));
+
+    UserDictionary user;
+    FCITX_ASSERT(UserDictionary::read(testUser + ".missing").empty());
+    load(user, "# comment\n"
+               "가:佳:아름다울 가\n"
+               "가능성:可能性:\n"
+               "가:嘉:\n",
+         2);
+    FCITX_ASSERT(user.keyCount() == 2);
+    FCITX_ASSERT(user.maxKeyLength() == 3);
+
+    // User entries come before the ones of the same key.
+    auto prefix = dict.matchPrefix("가능성");
+    user.matchPrefix("가능성", prefix);
+    FCITX_ASSERT(prefix.size() == 5) << prefix.size();
+    FCITX_ASSERT(prefix.keyCount() == 3);
+    FCITX_ASSERT(prefix.value(0) == "可能性");
+    FCITX_ASSERT(prefix.source(0) == HanjaMatches::OverlaySource);
+    FCITX_ASSERT(prefix.value(1) == "可能");
+    FCITX_ASSERT(prefix.source(1) == 0);
+    FCITX_ASSERT(prefix.value(2) == "佳");
+    FCITX_ASSERT(prefix.comment(2) == "아름다울 가");
+    FCITX_ASSERT(prefix.value(3) == "嘉");
+    FCITX_ASSERT(prefix.value(4) == "家");
+    FCITX_ASSERT(prefix.key(4) == "가");
+    FCITX_ASSERT(prefix.entryIndex(4) == 2);
+    FCITX_ASSERT(prefix.keyEntryCount(2) == 3);
+
+    auto suffix = dict.matchSuffix("아름다운 가능성");
+    user.matchSuffix("아름다운 가능성", suffix);
+    FCITX_ASSERT(suffix.size() == 1);
+    FCITX_ASSERT(suffix.key(0) == "가능성");
+
+    auto exact = HanjaMatches();
+    user.matchExact("가", exact);
+    FCITX_ASSERT(exact.size() == 2);
+    FCITX_ASSERT(exact.value(1) == "嘉");
+
+    // Only the changed keys are replaced.
+    load(user, "가:佳:아름다울 가\n"
+               "가:嘉:\n"
+               "능:能:\n",
+         2);
+    FCITX_ASSERT(user.keyCount() == 2);
+    FCITX_ASSERT(user.maxKeyLength() == 1);
+    // User entry replaces the one with the same value.
+    suffix = dict.matchSuffix("가능");
+    user.matchSuffix("가능", suffix);
+    FCITX_ASSERT(suffix.size() == 2) << suffix.size();
+    FCITX_ASSERT(suffix.value(0) == "可能");
+    FCITX_ASSERT(suffix.value(1) == "能");
+    FCITX_ASSERT(suffix.comment(1).empty());
+    FCITX_ASSERT(suffix.source(1) == HanjaMatches::OverlaySource);
+    FCITX_ASSERT(suffix.keyEntryCount(1) == 1);
+    FCITX_ASSERT(suffix.value(2).empty());
+
+    // Entries after the dropped one are still there.
+    load(user, "가:家:\n", 2);
+    writeFile(testSource, "가:佳:\n"
+                          "가:家:집 가\n"
+                          "가:嘉:\n");
+    image = HanjaDictionary::compile(testSource);
+    FCITX_ASSERT(image);
+    FCITX_ASSERT(dict.load(std::move(*image)));
+    exact = dict.matchExact("가");
+    user.matchExact("가", exact);
+    FCITX_ASSERT(exact.size() == 3);
+    FCITX_ASSERT(exact.value(0) == "家");
+    FCITX_ASSERT(exact.comment(0).empty());
+    FCITX_ASSERT(exact.value(1) == "佳");
+    FCITX_ASSERT(exact.value(2) == "嘉");
+    FCITX_ASSERT(exact.source(2) == 0);
+    exact.promote({2});
+    FCITX_ASSERT(exact.value(0) == "嘉");
+    FCITX_ASSERT(exact.value(2) == "佳");
+    load(user, "가:家:\n", 0);
+    load(user, "", 1);
+    FCITX_ASSERT(user.keyCount() == 0);
+    FCITX_ASSERT(user.maxKeyLength() == 0);
+}
+
+} // namespace
+
+int main() {
+    testOverlay();
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "testdir.h"
+#include "userhistory.h"
+#include <cstdint>
+#include <cstdio>
+#include <fcitx-utils/log.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace fcitx;
+
+namespace {
+
+const std::string testTable = TESTING_BINARY_DIR "/test/testuserhistory.dat";
+const std::string testLog = TESTING_BINARY_DIR "/test/testuserhistory.log";
+
+void checkPreferred(const UserHistory &history, std::string_view key,
+                    std::initializer_list<uint32_t> expect) {
+    UserHistory::Preferred preferred[UserHistory::MaxPreferred];
+    auto count = history.preferred(key, preferred);
+    FCITX_ASSERT(count == expect.size()) << key << " " << count;
+    size_t i = 0;
+    for (auto index : expect) {
+        FCITX_ASSERT(preferred[i].index == index) << key << " " << i;
+        i++;
+    }
+}
+
+void testHistory() {
+    std::remove(testTable.c_str());
+    std::remove(testLog.c_str());
+    {
+        UserHistory history;
+        history.open(testTable, testLog);
+        checkPreferred(history, "가", {});
+        history.add("가", "家", 0);
+        history.add("가", "假", 1);
+        history.add("가능", "可能", 0);
+        history.add("가", "家", 0);
+        checkPreferred(history, "가", {0, 1});
+        for (uint32_t i = 2; i < 8; i++) {
+            history.add("가", std::to_string(i), i);
+        }
+        // Only the most recent ones are kept.
+        checkPreferred(history, "가", {7, 6, 5, 4});
+    }
+
+    // Replay the log.
+    UserHistory history;
+    history.open(testTable, testLog);
+    checkPreferred(history, "가", {7, 6, 5, 4});
+    checkPreferred(history, "가능", {0});
+
+    // Compacted table gives the same result.
+    FCITX_ASSERT(history.compact());
+    history.add("나", "那", 3);
+    UserHistory reopened;
+    reopened.open(testTable, testLog);
+    checkPreferred(reopened, "가", {7, 6, 5, 4});
+    checkPreferred(reopened, "가능", {0});
+    checkPreferred(reopened, "나", {3});
+    checkPreferred(reopened, "다", {});
+
+    UserHistory::Preferred preferred[UserHistory::MaxPreferred];
+    reopened.preferred("가능", preferred);
+    FCITX_ASSERT(preferred[0].valueHash == UserHistory::valueHash("可能"));
+}
+
+// Table with more entries in a bucket than fit is ignored, the log is still
+// replayed.
+void testCorrupt() {
+    std::remove(testTable.c_str());
+    std::remove(testLog.c_str());
+    {
+        UserHistory history;
+        history.open(testTable, testLog);
+        history.add("가", "家", 0);
+        FCITX_ASSERT(history.compact());
+        history.add("나", "那", 3);
+    }
+    std::string table;
+    {
+        std::ifstream in(testTable, std::ios::in | std::ios::binary);
+        table.assign(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+    }
+    // Header is 32 bytes, and count is at offset 8 of each 48 bytes bucket.
+    FCITX_ASSERT(table.size() > 32 && (table.size() - 32) % 48 == 0);
+    for (size_t pos = 32; pos < table.size(); pos += 48) {
+        uint32_t count = 100;
+        table.replace(pos + 8, sizeof(count),
+                      reinterpret_cast<const char *>(&count), sizeof(count));
+    }
+    {
+        std::ofstream out(testTable, std::ios::out | std::ios::binary |
+                                         std::ios::trunc);
+        out << table;
+    }
+
+    UserHistory history;
+    history.open(testTable, testLog);
+    checkPreferred(history, "가", {});
+    checkPreferred(history, "나", {3});
+    history.add("가", "假", 1);
+    checkPreferred(history, "가", {1});
+}
+
+} // namespace
+
+int main() {
+    testHistory();
+    testCorrupt();
+    return 0;
+}